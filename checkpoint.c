@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "mat.h"
+#include "report.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC "MATCKPT"
+#define NAME_SIZE 32
+#define MAX_ENTRIES 4096
+
+/*
+ * crc_init:
+ * an auxiliary function
+ * fills "table" with the CRC-32 (IEEE 802.3) of every byte value, the
+ * table is kept by the caller, so no global state is involved.
+ */
+static void crc_init(unsigned long *table){
+    unsigned long c;
+    int i, k;
+    for(i = 0; i < 256; i++){
+        for(c = i, k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+}
+
+/*
+ * crc_update:
+ * an auxiliary function
+ * continues the CRC-32 "crc" over "size" bytes of "data", start with
+ * a crc of 0.
+ */
+static unsigned long crc_update(const unsigned long *table, unsigned long crc, const void *data, size_t size){
+    const unsigned char *p = data;
+    crc = ~crc & 0xFFFFFFFFUL;
+    while(size--)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc & 0xFFFFFFFFUL;
+}
+
+/*
+ * put_u32, put_u64, get_u32, get_u64:
+ * auxiliary functions
+ * store and fetch little endian integers, whatever the byte order of
+ * the machine, a 64 bit field holds a long, which may be narrower.
+ */
+static void put_u32(unsigned char *p, unsigned long value){
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+static void put_u64(unsigned char *p, unsigned long value){
+    put_u32(p, value & 0xFFFFFFFFUL);
+    put_u32(p + 4, (value >> 16) >> 16);
+}
+
+static unsigned long get_u32(const unsigned char *p){
+    return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long get_u64(const unsigned char *p, int *fits){
+    unsigned long high = get_u32(p + 4);
+    *fits = ((high << 16) << 16) >> 16 >> 16 == high;
+    return get_u32(p) | ((high << 16) << 16);
+}
+
+/*
+ * align:
+ * an auxiliary function
+ * rounds "offset" up to a multiple of CHECKPOINT_ALIGN.
+ */
+static long align(long offset){
+    return (offset + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+}
+
+/*
+ * save_entry:
+ * an auxiliary function
+ * writes the elements of "m" to "file" at "offset" and fills its table
+ * entry, "name" included.
+ */
+static checkpoint_status save_entry(FILE *file, const unsigned long *table, unsigned char *entry,
+                                    const char *name, const mat_t *m, long offset){
+    size_t count = (size_t)mat_rows(m) * mat_cols(m);
+    float *elements = malloc(count * sizeof(float));
+    checkpoint_status status = CHECKPOINT_OK;
+    if (elements == NULL)
+        return CHECKPOINT_ERR_ALLOC;
+    mat_store(m, elements);
+    if (fseek(file, offset, SEEK_SET) || fwrite(elements, sizeof(float), count, file) != count)
+        status = CHECKPOINT_ERR_IO;
+    memset(entry, 0, CHECKPOINT_ALIGN);
+    strncpy((char *)entry, name, NAME_SIZE - 1);
+    put_u32(entry + 32, mat_rows(m));
+    put_u32(entry + 36, mat_cols(m));
+    put_u64(entry + 40, offset);
+    put_u32(entry + 48, crc_update(table, 0, elements, count * sizeof(float)));
+    free(elements);
+    return status;
+}
+
+/*
+ * checkpoint_save:
+ * writes the "count" matrices in "matrices" (views as the elements
+ * they show) and the number of input lines processed to the file at
+ * "path", in the format described in "checkpoint.h". the checkpoint is
+ * written next to the file and renamed over it once complete, so an
+ * interrupted save never destroys the previous checkpoint.
+ */
+checkpoint_status checkpoint_save(const char *path, mat *matrices, int count, long line){
+    unsigned long table[256];
+    unsigned char *header;
+    char *temp_path;
+    long header_size = (long)(count + 1) * CHECKPOINT_ALIGN, offset = header_size;
+    checkpoint_status status = CHECKPOINT_OK;
+    float one = 1.0f;
+    FILE *file;
+    int i;
+    header = calloc(header_size, 1);
+    temp_path = malloc(strlen(path) + 5);
+    if (header == NULL || temp_path == NULL){
+        free(header);
+        free(temp_path);
+        return CHECKPOINT_ERR_ALLOC;
+    }
+    sprintf(temp_path, "%s.tmp", path);
+    if ((file = fopen(temp_path, "wb")) == NULL)
+        status = CHECKPOINT_ERR_OPEN;
+    crc_init(table);
+    for(i = 0; i < count && status == CHECKPOINT_OK; i++){
+        status = save_entry(file, table, header + (i + 1) * CHECKPOINT_ALIGN,
+                            matrices[i].name, matrices[i].data, offset);
+        offset = align(offset + (long)mat_rows(matrices[i].data) * mat_cols(matrices[i].data) * sizeof(float));
+    }
+    if (status == CHECKPOINT_OK){
+        memcpy(header, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        put_u32(header + 8, CHECKPOINT_VERSION);
+        memcpy(header + 12, &one, sizeof(float));
+        put_u32(header + 16, count);
+        put_u64(header + 24, line);
+        put_u32(header + 32, crc_update(table, 0, header, header_size));
+        if (fseek(file, 0, SEEK_SET) || fwrite(header, 1, header_size, file) != (size_t)header_size)
+            status = CHECKPOINT_ERR_IO;
+    }
+    if (file != NULL && fclose(file) && status == CHECKPOINT_OK)
+        status = CHECKPOINT_ERR_IO;
+    if (status == CHECKPOINT_OK && rename(temp_path, path))
+        status = CHECKPOINT_ERR_IO;
+    if (status != CHECKPOINT_OK && file != NULL)
+        remove(temp_path);
+    free(header);
+    free(temp_path);
+    return status;
+}
+
+/*
+ * read_header:
+ * an auxiliary function
+ * reads and checks the header and the table of "file", which is "size"
+ * bytes long, returns them in a new buffer through "header".
+ */
+static checkpoint_status read_header(FILE *file, long size, const unsigned long *table, unsigned char **header){
+    unsigned char first[CHECKPOINT_ALIGN];
+    unsigned long count, crc;
+    float one = 1.0f;
+    long header_size;
+    if (size < CHECKPOINT_ALIGN || fread(first, 1, CHECKPOINT_ALIGN, file) != CHECKPOINT_ALIGN)
+        return CHECKPOINT_ERR_FORMAT;
+    if (memcmp(first, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) || get_u32(first + 8) != CHECKPOINT_VERSION
+        || memcmp(first + 12, &one, sizeof(float)) || (count = get_u32(first + 16)) > MAX_ENTRIES)
+        return CHECKPOINT_ERR_FORMAT;
+    header_size = (long)(count + 1) * CHECKPOINT_ALIGN;
+    if (header_size > size)
+        return CHECKPOINT_ERR_FORMAT;
+    if ((*header = malloc(header_size)) == NULL)
+        return CHECKPOINT_ERR_ALLOC;
+    memcpy(*header, first, CHECKPOINT_ALIGN);
+    if (fread(*header + CHECKPOINT_ALIGN, 1, header_size - CHECKPOINT_ALIGN, file) != (size_t)(header_size - CHECKPOINT_ALIGN))
+        return CHECKPOINT_ERR_IO;
+    crc = get_u32(*header + 32);
+    put_u32(*header + 32, 0);
+    return crc == crc_update(table, 0, *header, header_size) ? CHECKPOINT_OK : CHECKPOINT_ERR_CHECKSUM;
+}
+
+/*
+ * load_entry:
+ * an auxiliary function
+ * checks the table entry "entry" against a file of "size" bytes and
+ * loads its elements into a new matrix, saved in "result".
+ */
+static checkpoint_status load_entry(FILE *file, long size, const unsigned long *table,
+                                    const unsigned char *entry, mat_t **result){
+    long rows = get_u32(entry + 32), cols = get_u32(entry + 36), offset;
+    float *elements;
+    size_t count;
+    int fits;
+    offset = get_u64(entry + 40, &fits);
+    if (!fits || rows <= 0 || cols <= 0 || rows > INT_MAX || cols > INT_MAX || offset % CHECKPOINT_ALIGN
+        || offset < 0 || offset > size || (size - offset) / (long)sizeof(float) / rows < cols)
+        return CHECKPOINT_ERR_FORMAT;
+    count = (size_t)rows * cols;
+    if ((elements = malloc(count * sizeof(float))) == NULL)
+        return CHECKPOINT_ERR_ALLOC;
+    if (fseek(file, offset, SEEK_SET) || fread(elements, sizeof(float), count, file) != count){
+        free(elements);
+        return CHECKPOINT_ERR_IO;
+    }
+    if (get_u32(entry + 48) != crc_update(table, 0, elements, count * sizeof(float))){
+        free(elements);
+        return CHECKPOINT_ERR_CHECKSUM;
+    }
+    if ((*result = mat_create(rows, cols)) != NULL)
+        mat_load(*result, elements);
+    free(elements);
+    return *result == NULL ? CHECKPOINT_ERR_ALLOC : CHECKPOINT_OK;
+}
+
+/*
+ * checkpoint_load:
+ * reads the checkpoint at "path" and replaces each of the "count"
+ * matrices in "matrices" it holds with a new matrix, matched by name,
+ * the number of input lines processed when it was taken is saved in
+ * "line". every block is checked before any matrix is replaced, so a
+ * damaged checkpoint leaves them all untouched.
+ */
+checkpoint_status checkpoint_load(const char *path, mat *matrices, int count, long *line){
+    unsigned long table[256], entries = 0;
+    unsigned char *header = NULL, *entry;
+    checkpoint_status status = CHECKPOINT_OK;
+    mat_t **loaded;
+    unsigned long i;
+    long size = 0;
+    FILE *file;
+    int j, fits = 1;
+    if ((loaded = calloc(count, sizeof(mat_t *))) == NULL)
+        return CHECKPOINT_ERR_ALLOC;
+    if ((file = fopen(path, "rb")) == NULL)
+        status = CHECKPOINT_ERR_OPEN;
+    else if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET))
+        status = CHECKPOINT_ERR_IO;
+    crc_init(table);
+    if (status == CHECKPOINT_OK)
+        status = read_header(file, size, table, &header);
+    if (status == CHECKPOINT_OK){
+        entries = get_u32(header + 16);
+        *line = get_u64(header + 24, &fits);
+        if (!fits || *line < 0)
+            status = CHECKPOINT_ERR_FORMAT;
+    }
+    for(i = 0; i < entries && status == CHECKPOINT_OK; i++){
+        entry = header + (i + 1) * CHECKPOINT_ALIGN;
+        entry[NAME_SIZE - 1] = '\0';
+        for(j = 0; j < count && strcmp((char *)entry, matrices[j].name); j++)
+            ;
+        if (j == count || loaded[j] != NULL)
+            status = CHECKPOINT_ERR_MATRIX;
+        else
+            status = load_entry(file, size, table, entry, &loaded[j]);
+    }
+    for(j = 0; j < count; j++){
+        if (loaded[j] != NULL && status == CHECKPOINT_OK){
+            mat_free(matrices[j].data);
+            matrices[j].data = loaded[j];
+        }
+        else if (loaded[j] != NULL)
+            mat_free(loaded[j]);
+    }
+    if (file != NULL)
+        fclose(file);
+    free(header);
+    free(loaded);
+    return status;
+}
+
+/*
+ * checkpoint_strerror:
+ * returns a message describing a checkpoint status code.
+ */
+const char *checkpoint_strerror(checkpoint_status status){
+    switch(status){
+        case CHECKPOINT_OK:
+            return "success";
+        case CHECKPOINT_ERR_OPEN:
+            return "cannot open checkpoint file";
+        case CHECKPOINT_ERR_IO:
+            return "cannot read or write checkpoint file";
+        case CHECKPOINT_ERR_FORMAT:
+            return "not a checkpoint file, or from an incompatible machine";
+        case CHECKPOINT_ERR_CHECKSUM:
+            return "checkpoint file is damaged";
+        case CHECKPOINT_ERR_MATRIX:
+            return "checkpoint holds an unknown or repeated matrix";
+        case CHECKPOINT_ERR_ALLOC:
+            return "out of memory";
+    }
+    return "unknown error";
+}
+
+/*
+ * checkpoint_matrices:
+ * takes a "parameters" structure and saves all the matrices, and the
+ * current input line, to the file named by the user.
+ */
+void checkpoint_matrices(parameters *params){
+    checkpoint_status status = checkpoint_save(params->path, params->matrices, MATRIX_COUNT, params->line_number);
+    if (status != CHECKPOINT_OK)
+        report_failure(params, checkpoint_strerror(status));
+}
+
+/*
+ * restore_matrices:
+ * takes a "parameters" structure and replaces the matrices with the
+ * ones saved in the file named by the user, the input position saved
+ * with them is ignored: it only matters when resuming a script (see
+ * the "-r" option in "mymat.c").
+ */
+void restore_matrices(parameters *params){
+    long line;
+    checkpoint_status status = checkpoint_load(params->path, params->matrices, MATRIX_COUNT, &line);
+    if (status != CHECKPOINT_OK)
+        report_failure(params, checkpoint_strerror(status));
+}
@@ -0,0 +1,52 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "mat.h"
+
+    /*
+     * a checkpoint file holds every matrix of the calculator and the
+     * number of input lines processed when it was taken. all integers
+     * are little endian, the elements are stored as raw floats in the
+     * byte order of the machine that wrote the file, each block aligned
+     * to CHECKPOINT_ALIGN bytes, so a mapped file can be used in place:
+     *
+     * header (CHECKPOINT_ALIGN bytes):
+     *   0  magic "MATCKPT" and a zero byte
+     *   8  format version (CHECKPOINT_VERSION)
+     *   12 the bytes of the float 1.0, to detect a foreign byte order
+     *   16 number of matrices
+     *   24 number of input lines processed (64 bits)
+     *   32 CRC-32 of the header (this field taken as 0) and the table
+     * table (CHECKPOINT_ALIGN bytes per matrix):
+     *   0  name, zero padded
+     *   32 rows
+     *   36 columns
+     *   40 offset of the elements from the start of the file (64 bits)
+     *   48 CRC-32 of the elements
+     * followed by the elements of each matrix, row by row.
+     */
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGN 64
+
+    /*
+     * checkpoint_status:
+     * the result of saving or loading a checkpoint, on failure the
+     * matrices (or the file being replaced) are left untouched.
+     */
+    typedef enum checkpoint_status {
+        CHECKPOINT_OK = 0,
+        CHECKPOINT_ERR_OPEN,
+        CHECKPOINT_ERR_IO,
+        CHECKPOINT_ERR_FORMAT,
+        CHECKPOINT_ERR_CHECKSUM,
+        CHECKPOINT_ERR_MATRIX,
+        CHECKPOINT_ERR_ALLOC
+    } checkpoint_status;
+
+    checkpoint_status checkpoint_save(const char*, mat*, int, long);
+    checkpoint_status checkpoint_load(const char*, mat*, int, long*);
+    const char *checkpoint_strerror(checkpoint_status);
+    void checkpoint_matrices(parameters*);
+    void restore_matrices(parameters*);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mat.h"
+#include "report.h"
+
+/*
+ * fuzz_line: the libFuzzer target of the parser of the calculator (see
+ * the "fuzz" target of the Makefile), the whole calculator is linked in
+ * with its "main" renamed, so only the functions below are run.
+ *
+ * the first byte of an input selects the format of the errors, the rest
+ * is split into lines which run through "process_line", as a session
+ * on the standard input would run them, on 6 fresh 4x4 matrices. the
+ * session may not read or write files, so "checkpoint" and "restore"
+ * don't litter the working directory.
+ */
+
+/*
+ * the same as in mymat.c: the shape of the matrices the calculator
+ * starts with and the size of the line buffer of a session.
+ */
+#define DEFAULT_SIZE 4
+#define MAX_LINE_SIZE 2048
+
+void process_line(session*, mat*, long, int*);
+
+/*
+ * null_output:
+ * an auxiliary function
+ * returns the stream the output of the sessions is thrown into, opened
+ * on the first call.
+ */
+static FILE *null_output(void){
+    static FILE *out = NULL;
+    if (out == NULL && (out = fopen("/dev/null", "w")) == NULL)
+        abort();
+    return out;
+}
+
+/*
+ * LLVMFuzzerTestOneInput:
+ * runs the lines of "data" through a session, like "run_session" does,
+ * until the input ends or a "stop" command. a line longer than the
+ * buffer of a session is cut, the rest of it is the next line.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    session ses;
+    char line[MAX_LINE_SIZE];
+    int i, stop_flag = 0;
+    long line_number = 0;
+    size_t at = 0;
+    mat matrices[] = { {"MAT_A", NULL}, {"MAT_B", NULL}, {"MAT_C", NULL},
+                        {"MAT_D", NULL}, {"MAT_E", NULL}, {"MAT_F", NULL}};
+    if (size == 0)
+        return 0;
+    ses.in = NULL;
+    ses.out = null_output();
+    ses.errors = data[at++] & 1 ? REPORT_JSON : REPORT_TEXT;
+    ses.files = 0;
+    ses.line = line;
+    ses.line_number = 0;
+    for(i = 0; i < MATRIX_COUNT; i++)
+        if ((matrices[i].data = mat_create(DEFAULT_SIZE, DEFAULT_SIZE)) == NULL)
+            abort();
+    while(at < size && !stop_flag){
+        for(i = 0; i < MAX_LINE_SIZE - 1 && at < size && data[at] != '\n'; i++)
+            line[i] = data[at++];
+        if (at < size && data[at] == '\n')
+            at++;
+        line[i] = '\n';
+        ses.length = i + 1;
+        ses.column = 0;
+        process_line(&ses, matrices, ++line_number, &stop_flag);
+    }
+    for(i = 0; i < MATRIX_COUNT; i++)
+        mat_free(matrices[i].data);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * kernelgen:
+ * writes libmat_kernels.h to the standard output: the kernels of the
+ * products, additions and transpositions of square matrices of the
+ * sizes KERNEL_MIN to KERNEL_MAX, with every loop over the size of
+ * the matrices unrolled, so the compiler sees constant offsets and can
+ * keep the operands in registers. run by the Makefile before the
+ * build, it is not part of the calculator.
+ */
+#include <stdio.h>
+
+#define KERNEL_MIN 2
+#define KERNEL_MAX 16
+
+/*
+ * gemm:
+ * an auxiliary function
+ * writes the product kernel of size n: c = alpha * a * b + beta * c.
+ * a row of c is kept in n accumulators while the rows of b are added
+ * into it, the same operations in the same order as "gemm_kernel" of
+ * libmat.c, so both give the same results. only the loop over the
+ * rows of c is left, with a constant trip count.
+ */
+static void gemm(int n){
+    int j, k;
+    printf("static void gemm_%d(float *c, long ldc, const float *a, long lda, const float *b, long ldb, float alpha, float beta){\n", n);
+    printf("    float t");
+    for(j = 0; j < n; j++)
+        printf(", c%d", j);
+    printf(";\n    int i;\n");
+    printf("    for(i = 0; i < %d; i++, c += ldc, a += lda){\n", n);
+    printf("        if (beta == 0.0f){\n");
+    for(j = 0; j < n; j++)
+        printf("            c%d = 0.0f;\n", j);
+    printf("        }\n        else {\n");
+    for(j = 0; j < n; j++)
+        printf("            c%d = beta * c[%d];\n", j, j);
+    printf("        }\n");
+    for(k = 0; k < n; k++){
+        printf("        t = alpha * a[%d];\n", k);
+        for(j = 0; j < n; j++)
+            printf("        c%d += t * b[%d * ldb + %d];\n", j, k, j);
+    }
+    for(j = 0; j < n; j++)
+        printf("        c[%d] = c%d;\n", j, j);
+    printf("    }\n}\n\n");
+}
+
+/*
+ * axpby:
+ * an auxiliary function
+ * writes the kernel of size n of c = alpha * a + beta * b, c may be one
+ * of the inputs, every element is read just before it's written.
+ */
+static void axpby(int n){
+    int i, j;
+    printf("static void axpby_%d(float *c, long ldc, const float *a, long lda, const float *b, long ldb, float alpha, float beta){\n", n);
+    for(i = 0; i < n; i++){
+        for(j = 0; j < n; j++)
+            printf("    c[%d * ldc + %d] = alpha * a[%d * lda + %d] + beta * b[%d * ldb + %d];\n", i, j, i, j, i, j);
+    }
+    printf("}\n\n");
+}
+
+/*
+ * trans:
+ * an auxiliary function
+ * writes the kernel of size n of c = a transposed, c must not overlap a.
+ */
+static void trans(int n){
+    int i, j;
+    printf("static void trans_%d(float *c, long ldc, const float *a, long lda){\n", n);
+    for(i = 0; i < n; i++){
+        for(j = 0; j < n; j++)
+            printf("    c[%d * ldc + %d] = a[%d * lda + %d];\n", i, j, j, i);
+    }
+    printf("}\n\n");
+}
+
+/*
+ * table:
+ * an auxiliary function
+ * writes the table "name"_kernels of type "type" indexed by size, NULL
+ * below KERNEL_MIN.
+ */
+static void table(const char *type, const char *name){
+    int n;
+    printf("static const %s %s_kernels[KERNEL_MAX + 1] = {\n   ", type, name);
+    for(n = 0; n <= KERNEL_MAX; n++){
+        if (n < KERNEL_MIN)
+            printf(" NULL,");
+        else
+            printf(" %s_%d%s", name, n, n < KERNEL_MAX ? "," : "\n");
+    }
+    printf("};\n\n");
+}
+
+int main(void){
+    int n;
+    printf("/*\n * libmat_kernels.h:\n * generated by kernelgen.c, do not edit.\n */\n\n");
+    printf("#ifndef LIBMAT_KERNELS_H\n#define LIBMAT_KERNELS_H\n\n");
+    printf("#define KERNEL_MIN %d\n#define KERNEL_MAX %d\n\n", KERNEL_MIN, KERNEL_MAX);
+    printf("typedef void (*gemm_fixed)(float *, long, const float *, long, const float *, long, float, float);\n");
+    printf("typedef void (*axpby_fixed)(float *, long, const float *, long, const float *, long, float, float);\n");
+    printf("typedef void (*trans_fixed)(float *, long, const float *, long);\n\n");
+    for(n = KERNEL_MIN; n <= KERNEL_MAX; n++){
+        gemm(n);
+        axpby(n);
+        trans(n);
+    }
+    table("gemm_fixed", "gemm");
+    table("axpby_fixed", "axpby");
+    table("trans_fixed", "trans");
+    printf("#endif\n");
+    return 0;
+}
@@ -0,0 +1,589 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libmat.h"
+#include "libmat_private.h"
+#include "libmat_kernels.h"
+
+#define GEMM_BLOCK 64
+
+/*
+ * next_id:
+ * the id given to the next handle created, the only state the library
+ * shares between threads, hence the lock.
+ */
+static unsigned long next_id = 1;
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * new_id:
+ * an auxiliary function
+ * returns a fresh handle id.
+ */
+static unsigned long new_id(void){
+    unsigned long id;
+    pthread_mutex_lock(&id_lock);
+    id = next_id++;
+    pthread_mutex_unlock(&id_lock);
+    return id;
+}
+
+/*
+ * mark_written:
+ * bumps the version of the storage of "m", called by every operation
+ * that writes to a matrix.
+ */
+void mark_written(mat_t *m){
+    pthread_mutex_lock(&m->buf->lock);
+    m->buf->version++;
+    pthread_mutex_unlock(&m->buf->lock);
+}
+
+/*
+ * mat_create:
+ * creates a rows x cols matrix, all elements initialized to zeros,
+ * placed as set by "mat_set_placement". returns NULL if the memory
+ * could not be allocated.
+ */
+mat_t *mat_create(int rows, int cols){
+    return mat_create_placed(rows, cols, default_placement());
+}
+
+/*
+ * mat_create_placed:
+ * works like "mat_create", the storage of the matrix is placed as
+ * "placement" says.
+ */
+mat_t *mat_create_placed(int rows, int cols, mat_placement placement){
+    mat_t *m;
+    mat_buf *buf;
+    if (rows <= 0 || cols <= 0)
+        return NULL;
+    m = malloc(sizeof(mat_t));
+    buf = malloc(sizeof(mat_buf));
+    if (m == NULL || buf == NULL || (buf->data = place_alloc(rows, cols, placement, &buf->mapped)) == NULL){
+        free(m);
+        free(buf);
+        return NULL;
+    }
+    buf->ld = cols;
+    buf->placement = placement;
+    buf->version = 0;
+    buf->refs = 1;
+    pthread_mutex_init(&buf->lock, NULL);
+    m->id = new_id();
+    m->buf = buf;
+    m->base = buf->data;
+    m->rows = rows;
+    m->cols = cols;
+    m->rs = cols;
+    m->cs = 1;
+    m->is_view = 0;
+    return m;
+}
+
+/*
+ * mat_view:
+ * returns a handle to the rows x cols block of "parent" whose top left
+ * corner is (row, col), no data is copied: writing to the view writes
+ * to the parent. returns NULL if the block is out of range.
+ */
+mat_t *mat_view(mat_t *parent, int row, int col, int rows, int cols){
+    return mat_slice(parent, row, col, rows, cols, 1, 1, 0);
+}
+
+/*
+ * mat_slice:
+ * the general form of "mat_view": selects "rows" rows of "parent"
+ * starting at "row" and advancing by "row_step", and likewise for the
+ * columns. if "transpose" is set, the handle presents the selected
+ * block transposed, still without copying. returns NULL if any of the
+ * selected elements is out of range.
+ */
+mat_t *mat_slice(mat_t *parent, int row, int col, int rows, int cols, int row_step, int col_step, int transpose){
+    mat_t *m;
+    if (row < 0 || col < 0 || rows <= 0 || cols <= 0 || row_step <= 0 || col_step <= 0 ||
+            row + (rows - 1) * row_step >= parent->rows || col + (cols - 1) * col_step >= parent->cols)
+        return NULL;
+    if ((m = malloc(sizeof(mat_t))) == NULL)
+        return NULL;
+    *m = *parent;
+    m->id = new_id();
+    m->base = &AT(parent, row, col);
+    m->rows = transpose ? cols : rows;
+    m->cols = transpose ? rows : cols;
+    m->rs = transpose ? parent->cs * col_step : parent->rs * row_step;
+    m->cs = transpose ? parent->rs * row_step : parent->cs * col_step;
+    m->is_view = 1;
+    pthread_mutex_lock(&m->buf->lock);
+    m->buf->refs++;
+    pthread_mutex_unlock(&m->buf->lock);
+    return m;
+}
+
+/*
+ * mat_dup:
+ * returns a new matrix which owns a copy of the elements of "src",
+ * placed like "src".
+ */
+mat_t *mat_dup(const mat_t *src){
+    mat_t *m = mat_create_placed(src->rows, src->cols, src->buf->placement);
+    if (m != NULL)
+        mat_copy(m, src);
+    return m;
+}
+
+/*
+ * mat_free:
+ * releases the handle, the storage itself is freed only when no other
+ * handle (view) refers to it.
+ */
+void mat_free(mat_t *m){
+    int refs;
+    if (m == NULL)
+        return;
+    pthread_mutex_lock(&m->buf->lock);
+    refs = --m->buf->refs;
+    pthread_mutex_unlock(&m->buf->lock);
+    if (refs == 0){
+        pthread_mutex_destroy(&m->buf->lock);
+        place_free(m->buf->data, m->buf->mapped);
+        free(m->buf);
+    }
+    free(m);
+}
+
+int mat_rows(const mat_t *m){
+    return m->rows;
+}
+
+int mat_cols(const mat_t *m){
+    return m->cols;
+}
+
+/*
+ * mat_id:
+ * returns the id of the handle, unique for the lifetime of the program.
+ */
+unsigned long mat_id(const mat_t *m){
+    return m->id;
+}
+
+/*
+ * mat_version:
+ * returns a number that changes whenever the elements of the handle
+ * may have changed. it is shared by all the handles viewing the same
+ * storage, so writing to a view changes the version of its parent.
+ * (id, version) identifies the contents of a handle.
+ */
+unsigned long mat_version(const mat_t *m){
+    unsigned long version;
+    pthread_mutex_lock(&m->buf->lock);
+    version = m->buf->version;
+    pthread_mutex_unlock(&m->buf->lock);
+    return version;
+}
+
+/*
+ * mat_is_view:
+ * returns 1 if the handle was created by "mat_view" or "mat_slice".
+ */
+int mat_is_view(const mat_t *m){
+    return m->is_view;
+}
+
+/*
+ * mat_is_shared:
+ * returns 1 if other handles refer to the storage of the handle, that
+ * is, it is a view or has views.
+ */
+int mat_is_shared(const mat_t *m){
+    int refs;
+    pthread_mutex_lock(&m->buf->lock);
+    refs = m->buf->refs;
+    pthread_mutex_unlock(&m->buf->lock);
+    return refs > 1;
+}
+
+float mat_get(const mat_t *m, int i, int j){
+    return AT(m, i, j);
+}
+
+void mat_set(mat_t *m, int i, int j, float value){
+    AT(m, i, j) = value;
+    mark_written(m);
+}
+
+/*
+ * mat_load:
+ * fills the matrix from "values", which holds rows * cols elements
+ * in row major order.
+ */
+void mat_load(mat_t *m, const float *values){
+    int i, j;
+    for(i = 0; i < m->rows; i++){
+        for(j = 0; j < m->cols; j++){
+            AT(m, i, j) = *values++;
+        }
+    }
+    mark_written(m);
+}
+
+/*
+ * mat_store:
+ * the opposite of "mat_load", writes the elements to "values" in row
+ * major order.
+ */
+void mat_store(const mat_t *m, float *values){
+    int i, j;
+    for(i = 0; i < m->rows; i++){
+        for(j = 0; j < m->cols; j++){
+            *values++ = AT(m, i, j);
+        }
+    }
+}
+
+/*
+ * bounding_box:
+ * an auxiliary function
+ * finds the rows and columns of the owner of the storage that the
+ * handle touches, saved in "box" as first row, last row, first column
+ * and last column. returns 0 if the strides of the handle can't be
+ * described that way, which never happens for views made by "mat_slice".
+ */
+static int bounding_box(const mat_t *m, long *box){
+    long ld = m->buf->ld, offset = m->base - m->buf->data;
+    if ((m->rs % ld && m->rs >= ld) || (m->cs % ld && m->cs >= ld))
+        return 0;
+    box[0] = offset / ld;
+    box[1] = box[0] + (m->rows - 1) * (m->rs / ld) + (m->cols - 1) * (m->cs / ld);
+    box[2] = offset % ld;
+    box[3] = box[2] + (m->rows - 1) * (m->rs % ld) + (m->cols - 1) * (m->cs % ld);
+    return box[3] < ld;
+}
+
+/*
+ * may_overlap:
+ * returns 1 if the two handles may address a common element, that is
+ * if they share storage and their bounding boxes intersect. disjoint
+ * blocks of one matrix, like the panels of a blocked factorization,
+ * don't overlap.
+ */
+int may_overlap(const mat_t *a, const mat_t *b){
+    long box_a[4], box_b[4];
+    if (a->buf != b->buf)
+        return 0;
+    if (!bounding_box(a, box_a) || !bounding_box(b, box_b))
+        return 1;
+    return box_a[0] <= box_b[1] && box_b[0] <= box_a[1] &&
+            box_a[2] <= box_b[3] && box_b[2] <= box_a[3];
+}
+
+/*
+ * needs_temp:
+ * an auxiliary function
+ * element-wise operations may write their output over one of their
+ * inputs only if both handles address every element identically, any
+ * other overlap requires computing into a temporary matrix.
+ */
+static int needs_temp(const mat_t *dst, const mat_t *src){
+    return may_overlap(dst, src) &&
+            !(dst->base == src->base && dst->rs == src->rs && dst->cs == src->cs);
+}
+
+/*
+ * via_temp:
+ * an auxiliary function
+ * computes "dst" by calling "op" on a temporary matrix of the same shape,
+ * then copies the result into "dst", used when "dst" overlaps an input.
+ * "dst" is copied into the temporary first, for operations that read it.
+ */
+static mat_status via_temp(mat_t *dst, const mat_t *a, const mat_t *b, float alpha, float beta,
+                            mat_status (*op)(mat_t *, const mat_t *, const mat_t *, float, float)){
+    mat_status status;
+    mat_t *temp = mat_dup(dst);
+    if (temp == NULL)
+        return MAT_ERR_ALLOC;
+    if ((status = op(temp, a, b, alpha, beta)) == MAT_OK)
+        mat_copy(dst, temp);
+    mat_free(temp);
+    return status;
+}
+
+/*
+ * mat_copy:
+ * copies the elements of "src" into "dst", both must have the same shape.
+ */
+mat_status mat_copy(mat_t *dst, const mat_t *src){
+    int i, j;
+    mat_t *temp;
+    if (dst->rows != src->rows || dst->cols != src->cols)
+        return MAT_ERR_SHAPE;
+    if (dst->base == src->base && dst->rs == src->rs && dst->cs == src->cs)
+        return MAT_OK;
+    if (may_overlap(dst, src)){
+        if ((temp = mat_dup(src)) == NULL)
+            return MAT_ERR_ALLOC;
+        mat_copy(dst, temp);
+        mat_free(temp);
+        return MAT_OK;
+    }
+    for(i = 0; i < dst->rows; i++){
+        for(j = 0; j < dst->cols; j++){
+            AT(dst, i, j) = AT(src, i, j);
+        }
+    }
+    mark_written(dst);
+    return MAT_OK;
+}
+
+/*
+ * scale_in_place:
+ * an auxiliary function
+ * multiplies every element of "m" by "beta", zero is written explicitly
+ * rather than multiplied, so stale NaNs in an output do not survive.
+ */
+static void scale_in_place(mat_t *m, float beta){
+    int i, j;
+    for(i = 0; i < m->rows; i++){
+        for(j = 0; j < m->cols; j++){
+            AT(m, i, j) = beta == 0.0f ? 0.0f : beta * AT(m, i, j);
+        }
+    }
+}
+
+/*
+ * fixed_size:
+ * an auxiliary function
+ * returns the size of the generated kernels of "libmat_kernels.h" that
+ * apply to the operands, all of them square of a size between
+ * KERNEL_MIN and KERNEL_MAX with contiguous rows ("b" may be NULL), 0
+ * if they don't apply.
+ */
+static int fixed_size(const mat_t *c, const mat_t *a, const mat_t *b){
+    int n = c->rows;
+    if (n < KERNEL_MIN || n > KERNEL_MAX || c->cols != n || c->cs != 1)
+        return 0;
+    if (a->rows != n || a->cols != n || a->cs != 1)
+        return 0;
+    if (b != NULL && (b->rows != n || b->cols != n || b->cs != 1))
+        return 0;
+    return n;
+}
+
+/*
+ * gemm_kernel:
+ * adds alpha * a * b to c. the k and j loops are blocked so a panel of
+ * b stays in cache while it is reused by every row of a, the innermost
+ * loop walks a row of b and c, which is contiguous for owned matrices.
+ */
+void gemm_kernel(mat_t *c, const mat_t *a, const mat_t *b, float alpha){
+    int i, j, k, kk, jj, k_end, j_end;
+    float aik, *crow;
+    const float *brow;
+    for(kk = 0; kk < a->cols; kk += GEMM_BLOCK){
+        k_end = kk + GEMM_BLOCK < a->cols ? kk + GEMM_BLOCK : a->cols;
+        for(jj = 0; jj < c->cols; jj += GEMM_BLOCK){
+            j_end = jj + GEMM_BLOCK < c->cols ? jj + GEMM_BLOCK : c->cols;
+            for(i = 0; i < c->rows; i++){
+                crow = &AT(c, i, 0);
+                for(k = kk; k < k_end; k++){
+                    aik = alpha * AT(a, i, k);
+                    brow = &AT(b, k, 0);
+                    if (c->cs == 1 && b->cs == 1){
+                        for(j = jj; j < j_end; j++)
+                            crow[j] += aik * brow[j];
+                    }
+                    else {
+                        for(j = jj; j < j_end; j++)
+                            crow[j * c->cs] += aik * brow[j * b->cs];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * gemm_args:
+ * the arguments of a product split by rows among the pool threads.
+ */
+typedef struct gemm_args {
+    mat_t *c;
+    const mat_t *a, *b;
+    float alpha;
+} gemm_args;
+
+/*
+ * gemm_part:
+ * an auxiliary function
+ * the pool task of "mat_gemm": runs the kernel on one band of rows of
+ * c and a, described by shallow copies of their handles.
+ */
+static void gemm_part(void *arg, int part, int parts){
+    gemm_args *args = arg;
+    mat_t c = *args->c, a = *args->a;
+    int first = (int)((long)c.rows * part / parts), last = (int)((long)c.rows * (part + 1) / parts);
+    c.base += first * c.rs;
+    a.base += first * a.rs;
+    c.rows = a.rows = last - first;
+    gemm_kernel(&c, &a, args->b, args->alpha);
+}
+
+/*
+ * mat_gemm:
+ * c = alpha * a * b + beta * c, a must be m x k, b k x n and c m x n.
+ * c may be one of the inputs (or share storage with them), in which
+ * case the product is formed in a temporary matrix. small square
+ * products run the generated kernel of their size, large products
+ * are split in blocks among the worker processes of "mat_grid_start"
+ * if they are running, by rows among the pool threads otherwise.
+ */
+mat_status mat_gemm(mat_t *c, const mat_t *a, const mat_t *b, float alpha, float beta){
+    gemm_args args;
+    int n;
+    if (a->cols != b->rows || c->rows != a->rows || c->cols != b->cols)
+        return MAT_ERR_SHAPE;
+    if (may_overlap(c, a) || may_overlap(c, b))
+        return via_temp(c, a, b, alpha, beta, mat_gemm);
+    if ((n = fixed_size(c, a, b)) != 0){
+        gemm_kernels[n](c->base, c->rs, a->base, a->rs, b->base, b->rs, alpha, beta);
+        mark_written(c);
+        return MAT_OK;
+    }
+    if (grid_gemm(c, a, b, alpha, beta)){
+        mark_written(c);
+        return MAT_OK;
+    }
+    scale_in_place(c, beta);
+    args.c = c;
+    args.a = a;
+    args.b = b;
+    args.alpha = alpha;
+    pool_run(gemm_part, &args, pool_parts((double)c->rows * c->cols * a->cols, c->rows));
+    mark_written(c);
+    return MAT_OK;
+}
+
+/*
+ * axpby:
+ * an auxiliary function
+ * c = alpha * a + beta * b, the common body of addition and subtraction.
+ */
+static mat_status axpby(mat_t *c, const mat_t *a, const mat_t *b, float alpha, float beta){
+    int i, j, n;
+    if (a->rows != b->rows || a->cols != b->cols || c->rows != a->rows || c->cols != a->cols)
+        return MAT_ERR_SHAPE;
+    if (needs_temp(c, a) || needs_temp(c, b))
+        return via_temp(c, a, b, alpha, beta, axpby);
+    if ((n = fixed_size(c, a, b)) != 0)
+        axpby_kernels[n](c->base, c->rs, a->base, a->rs, b->base, b->rs, alpha, beta);
+    else {
+        for(i = 0; i < c->rows; i++){
+            for(j = 0; j < c->cols; j++){
+                AT(c, i, j) = alpha * AT(a, i, j) + beta * AT(b, i, j);
+            }
+        }
+    }
+    mark_written(c);
+    return MAT_OK;
+}
+
+/*
+ * mat_add:
+ * c = a + b.
+ */
+mat_status mat_add(mat_t *c, const mat_t *a, const mat_t *b){
+    return axpby(c, a, b, 1.0f, 1.0f);
+}
+
+/*
+ * mat_sub:
+ * c = a - b.
+ */
+mat_status mat_sub(mat_t *c, const mat_t *a, const mat_t *b){
+    return axpby(c, a, b, 1.0f, -1.0f);
+}
+
+/*
+ * scale:
+ * an auxiliary function
+ * c = alpha * a, "b" and "beta" are unused, they only match the
+ * signature expected by "via_temp".
+ */
+static mat_status scale(mat_t *c, const mat_t *a, const mat_t *b, float alpha, float beta){
+    int i, j;
+    if (c->rows != a->rows || c->cols != a->cols)
+        return MAT_ERR_SHAPE;
+    if (needs_temp(c, a))
+        return via_temp(c, a, b, alpha, beta, scale);
+    for(i = 0; i < c->rows; i++){
+        for(j = 0; j < c->cols; j++){
+            AT(c, i, j) = alpha * AT(a, i, j);
+        }
+    }
+    mark_written(c);
+    return MAT_OK;
+}
+
+/*
+ * mat_scale:
+ * c = alpha * a.
+ */
+mat_status mat_scale(mat_t *c, const mat_t *a, float alpha){
+    return scale(c, a, NULL, alpha, 0.0f);
+}
+
+/*
+ * trans:
+ * an auxiliary function
+ * c = a transposed, see "scale" for the unused parameters.
+ */
+static mat_status trans(mat_t *c, const mat_t *a, const mat_t *b, float alpha, float beta){
+    int i, j, n;
+    if (c->rows != a->cols || c->cols != a->rows)
+        return MAT_ERR_SHAPE;
+    if (may_overlap(c, a))
+        return via_temp(c, a, b, alpha, beta, trans);
+    if ((n = fixed_size(c, a, NULL)) != 0)
+        trans_kernels[n](c->base, c->rs, a->base, a->rs);
+    else {
+        for(i = 0; i < c->rows; i++){
+            for(j = 0; j < c->cols; j++){
+                AT(c, i, j) = AT(a, j, i);
+            }
+        }
+    }
+    mark_written(c);
+    return MAT_OK;
+}
+
+/*
+ * mat_trans:
+ * c = a transposed, c must be cols x rows of a.
+ */
+mat_status mat_trans(mat_t *c, const mat_t *a){
+    return trans(c, a, NULL, 1.0f, 0.0f);
+}
+
+/*
+ * mat_strerror:
+ * returns a message describing a status code.
+ */
+const char *mat_strerror(mat_status status){
+    switch(status){
+        case MAT_OK:
+            return "success";
+        case MAT_ERR_ALLOC:
+            return "out of memory";
+        case MAT_ERR_SHAPE:
+            return "matrix dimensions do not match";
+        case MAT_ERR_RANGE:
+            return "index out of range";
+        case MAT_ERR_SINGULAR:
+            return "matrix is singular";
+        case MAT_ERR_NOT_SPD:
+            return "matrix is not positive definite";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,137 @@
+#ifndef LIBMAT_H
+#define LIBMAT_H
+
+    /*
+     * mat_t:
+     * an opaque handle to a matrix of floats. a handle either owns its
+     * storage (created by "mat_create") or shares the storage of another
+     * handle (created by "mat_view"), the storage is released when the
+     * last handle referring to it is freed. the library keeps no global
+     * state other than a locked counter for handle ids, the thread pool
+     * started by "mat_pool_start", the worker processes started by
+     * "mat_grid_start" and the placement set by "mat_set_placement",
+     * which every thread shares, so different threads
+     * may use it freely as long as no two of them write to the same
+     * storage at the same time ("mat_is_shared" tells whether other
+     * handles see the storage of a handle).
+     */
+    typedef struct mat_t mat_t;
+
+    /*
+     * mat_status:
+     * the result of every library operation, MAT_OK means success,
+     * anything else describes why the operation was refused, in which
+     * case the output matrix is left untouched.
+     */
+    typedef enum mat_status {
+        MAT_OK = 0,
+        MAT_ERR_ALLOC,
+        MAT_ERR_SHAPE,
+        MAT_ERR_RANGE,
+        MAT_ERR_SINGULAR,
+        MAT_ERR_NOT_SPD
+    } mat_status;
+
+    /*
+     * mat_norm_kind:
+     * the norms "mat_norm" computes: Frobenius, 1 (largest absolute
+     * column sum) and infinity (largest absolute row sum).
+     */
+    typedef enum mat_norm_kind {
+        MAT_NORM_FRO = 0,
+        MAT_NORM_ONE,
+        MAT_NORM_INF
+    } mat_norm_kind;
+
+    /*
+     * mat_placement:
+     * where the pages of a large matrix (2MB or more, smaller ones come
+     * from the heap) are put on a machine with several memory nodes:
+     * MAT_PLACE_LOCAL leaves them to whichever thread writes them
+     * first, MAT_PLACE_PARTITION gives every pool thread the pages of
+     * the band of rows it computes in the operations split by rows (so
+     * pin the pool, see "mat_pool_pin"), MAT_PLACE_INTERLEAVE spreads
+     * them over all the nodes, which suits matrices every thread reads
+     * whole, like the right operand of a product. large matrices are
+     * backed by huge pages where the system has them.
+     */
+    typedef enum mat_placement {
+        MAT_PLACE_LOCAL = 0,
+        MAT_PLACE_PARTITION,
+        MAT_PLACE_INTERLEAVE
+    } mat_placement;
+
+    /*
+     * mat_map_op:
+     * the element-wise operations "mat_map" chains: add, subtract,
+     * multiply or divide by an operand, e ^ x (a fast approximation,
+     * within a few ulp of "exp" over the range of the floats), the
+     * positive part max(x, 0), and clamping to [scalar, limit].
+     */
+    typedef enum mat_map_op {
+        MAT_MAP_ADD = 0,
+        MAT_MAP_SUB,
+        MAT_MAP_MUL,
+        MAT_MAP_DIV,
+        MAT_MAP_EXP,
+        MAT_MAP_RELU,
+        MAT_MAP_CLAMP
+    } mat_map_op;
+
+    /*
+     * mat_map_step:
+     * a step of "mat_map": the operand of the arithmetic operations is
+     * "operand" if it isn't NULL, else "scalar". the bounds of
+     * MAT_MAP_CLAMP are "scalar" and "limit".
+     */
+    typedef struct mat_map_step {
+        mat_map_op op;
+        const mat_t *operand;
+        float scalar;
+        float limit;
+    } mat_map_step;
+
+    mat_t *mat_create(int, int);
+    mat_t *mat_create_placed(int, int, mat_placement);
+    void mat_set_placement(mat_placement);
+    mat_t *mat_view(mat_t *, int, int, int, int);
+    mat_t *mat_slice(mat_t *, int, int, int, int, int, int, int);
+    mat_t *mat_dup(const mat_t *);
+    void mat_free(mat_t *);
+    int mat_rows(const mat_t *);
+    int mat_cols(const mat_t *);
+    unsigned long mat_id(const mat_t *);
+    unsigned long mat_version(const mat_t *);
+    int mat_is_view(const mat_t *);
+    int mat_is_shared(const mat_t *);
+    float mat_get(const mat_t *, int, int);
+    void mat_set(mat_t *, int, int, float);
+    void mat_load(mat_t *, const float *);
+    void mat_store(const mat_t *, float *);
+    mat_status mat_copy(mat_t *, const mat_t *);
+    mat_status mat_gemm(mat_t *, const mat_t *, const mat_t *, float, float);
+    mat_status mat_add(mat_t *, const mat_t *, const mat_t *);
+    mat_status mat_sub(mat_t *, const mat_t *, const mat_t *);
+    mat_status mat_scale(mat_t *, const mat_t *, float);
+    mat_status mat_trans(mat_t *, const mat_t *);
+    mat_status mat_lu(mat_t *, int *, const mat_t *);
+    mat_status mat_chol(mat_t *, const mat_t *);
+    mat_status mat_qr(mat_t *, mat_t *, const mat_t *);
+    mat_status mat_solve(mat_t *, const mat_t *, const mat_t *);
+    mat_status mat_inv(mat_t *, const mat_t *);
+    mat_status mat_det(const mat_t *, float *);
+    mat_status mat_sum(const mat_t *, float *);
+    mat_status mat_norm(const mat_t *, mat_norm_kind, float *);
+    mat_status mat_trace(const mat_t *, float *);
+    mat_status mat_minmax(const mat_t *, float *, float *);
+    mat_status mat_row_sums(mat_t *, const mat_t *);
+    mat_status mat_col_sums(mat_t *, const mat_t *);
+    mat_status mat_map(mat_t *, const mat_t *, const mat_map_step *, int);
+    const char *mat_strerror(mat_status);
+    mat_status mat_pool_start(int);
+    void mat_pool_stop(void);
+    void mat_pool_pin(int);
+    mat_status mat_grid_start(int);
+    void mat_grid_stop(void);
+
+#endif
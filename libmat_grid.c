@@ -0,0 +1,353 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+#define GRID_MIN_WORK (1L << 24)
+#define SUMMA_PANEL 256
+
+/*
+ * grid_job:
+ * the message the coordinator sends a worker process for its part of
+ * a product: the size of the arena now (it only grows), and where the
+ * band of a (rows x depth), the band of b (depth x cols) and the block
+ * of c (rows x cols) of the worker are in it, as offsets in floats,
+ * each stored by rows without gaps.
+ */
+typedef struct grid_job {
+    long arena_size;
+    long a, b, c;
+    int rows, cols, depth;
+    float alpha;
+} grid_job;
+
+/*
+ * the grid: "grid_count" worker processes in "grid_rows" rows, the
+ * coordinator (the process that started them) talks to each through
+ * its socket in "sockets". the operands are passed in the arena, an
+ * unlinked file of "arena_size" bytes that every process maps shared.
+ * all of this is guarded by "grid_lock", a product that finds the grid
+ * busy runs in its own process instead of waiting.
+ */
+static pthread_mutex_t grid_lock = PTHREAD_MUTEX_INITIALIZER;
+static int grid_count, grid_rows, arena_fd = -1;
+static int *sockets;
+static pid_t *pids;
+static float *arena;
+static long arena_size;
+
+/*
+ * map_arena:
+ * an auxiliary function
+ * maps the first "size" bytes of the arena, returns NULL on failure.
+ */
+static float *map_arena(long size){
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, arena_fd, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+/*
+ * transfer:
+ * an auxiliary function
+ * sends (if "sending" is set) or receives the "size" bytes at "data"
+ * through the socket "fd", returns 0 if the other side is gone.
+ */
+static int transfer(int fd, void *data, size_t size, int sending){
+    char *next = data;
+    ssize_t done;
+    while(size > 0){
+        done = sending ? send(fd, next, size, MSG_NOSIGNAL) : recv(fd, next, size, 0);
+        if (done <= 0)
+            return 0;
+        next += done;
+        size -= done;
+    }
+    return 1;
+}
+
+/*
+ * block:
+ * an auxiliary function
+ * makes "m" a handle to the rows x cols matrix stored by rows at "base",
+ * without any storage of its own, enough for "gemm_kernel".
+ */
+static void block(mat_t *m, float *base, int rows, int cols){
+    memset(m, 0, sizeof(mat_t));
+    m->base = base;
+    m->rows = rows;
+    m->cols = cols;
+    m->rs = cols;
+    m->cs = 1;
+    m->is_view = 1;
+}
+
+/*
+ * summa:
+ * an auxiliary function
+ * c += alpha * a * b on the blocks of a worker, a panel of SUMMA_PANEL
+ * columns of a and rows of b at a time, in the order of SUMMA: the
+ * panels of a are shared by the workers of a grid row and those of b
+ * by the workers of a grid column, so on separate machines each step
+ * is where the panels would be broadcast along them.
+ */
+static void summa(mat_t *c, const mat_t *a, const mat_t *b, float alpha){
+    mat_t a_panel = *a, b_panel = *b;
+    int k;
+    for(k = 0; k < a->cols; k += SUMMA_PANEL){
+        a_panel.base = a->base + k;
+        b_panel.base = b->base + (long)k * b->cols;
+        a_panel.cols = b_panel.rows = a->cols - k < SUMMA_PANEL ? a->cols - k : SUMMA_PANEL;
+        gemm_kernel(c, &a_panel, &b_panel, alpha);
+    }
+}
+
+/*
+ * grid_worker:
+ * an auxiliary function
+ * the body of a worker process: adds its part of every product the
+ * coordinator sends through "fd" to its block of c and answers with a
+ * byte when it's done, until the coordinator closes the socket.
+ */
+static void grid_worker(int fd){
+    grid_job job;
+    mat_t a, b, c;
+    float *mem = NULL;
+    long mapped = 0;
+    char done = 1;
+    while(transfer(fd, &job, sizeof(job), 0)){
+        if (job.arena_size != mapped){
+            if (mem != NULL)
+                munmap(mem, mapped);
+            if ((mem = map_arena(job.arena_size)) == NULL)
+                break;
+            mapped = job.arena_size;
+        }
+        block(&a, mem + job.a, job.rows, job.depth);
+        block(&b, mem + job.b, job.depth, job.cols);
+        block(&c, mem + job.c, job.rows, job.cols);
+        summa(&c, &a, &b, job.alpha);
+        if (!transfer(fd, &done, 1, 1))
+            break;
+    }
+    _exit(0);
+}
+
+/*
+ * stop_grid:
+ * an auxiliary function
+ * the body of "mat_grid_stop", "grid_lock" must be held.
+ */
+static void stop_grid(void){
+    int i;
+    for(i = 0; i < grid_count; i++)
+        close(sockets[i]);
+    for(i = 0; i < grid_count; i++)
+        waitpid(pids[i], NULL, 0);
+    if (arena != NULL)
+        munmap(arena, arena_size);
+    if (arena_fd >= 0)
+        close(arena_fd);
+    free(sockets);
+    free(pids);
+    sockets = NULL;
+    pids = NULL;
+    arena = NULL;
+    arena_size = 0;
+    arena_fd = -1;
+    grid_count = grid_rows = 0;
+}
+
+/*
+ * mat_grid_start:
+ * starts "workers" worker processes on this machine, arranged in a grid
+ * as square as their number allows. large products are then split in
+ * blocks among them (see "grid_gemm"). a grid that is already running
+ * is stopped first, 0 workers leaves it stopped. the workers are forked
+ * copies of the calling process, so it must be called before any other
+ * thread is started, the compute pool included. returns MAT_ERR_ALLOC
+ * if the workers could not be started.
+ */
+mat_status mat_grid_start(int workers){
+    char path[] = "/tmp/libmat-XXXXXX";
+    int pair[2], i;
+    mat_grid_stop();
+    if (workers <= 0)
+        return MAT_OK;
+    pthread_mutex_lock(&grid_lock);
+    sockets = malloc(workers * sizeof(int));
+    pids = malloc(workers * sizeof(pid_t));
+    if (sockets == NULL || pids == NULL || (arena_fd = mkstemp(path)) < 0){
+        stop_grid();
+        pthread_mutex_unlock(&grid_lock);
+        return MAT_ERR_ALLOC;
+    }
+    unlink(path);
+    fflush(NULL);
+    for(i = 0; i < workers; i++){
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
+            break;
+        if ((pids[i] = fork()) < 0){
+            close(pair[0]);
+            close(pair[1]);
+            break;
+        }
+        if (pids[i] == 0){
+            while(i-- > 0)
+                close(sockets[i]);
+            close(pair[0]);
+            grid_worker(pair[1]);
+        }
+        close(pair[1]);
+        sockets[grid_count++] = pair[0];
+    }
+    for(grid_rows = 1; (grid_rows + 1) * (grid_rows + 1) <= grid_count; grid_rows++)
+        ;
+    while(grid_count % grid_rows)
+        grid_rows--;
+    if (i < workers){
+        stop_grid();
+        pthread_mutex_unlock(&grid_lock);
+        return MAT_ERR_ALLOC;
+    }
+    pthread_mutex_unlock(&grid_lock);
+    return MAT_OK;
+}
+
+/*
+ * mat_grid_stop:
+ * stops the worker processes, no operation may be running meanwhile.
+ */
+void mat_grid_stop(void){
+    pthread_mutex_lock(&grid_lock);
+    stop_grid();
+    pthread_mutex_unlock(&grid_lock);
+}
+
+/*
+ * grow_arena:
+ * an auxiliary function
+ * makes the arena at least "size" bytes long, returns 0 on failure.
+ */
+static int grow_arena(long size){
+    float *mem;
+    if (size <= arena_size)
+        return 1;
+    if (ftruncate(arena_fd, size) || (mem = map_arena(size)) == NULL)
+        return 0;
+    if (arena != NULL)
+        munmap(arena, arena_size);
+    arena = mem;
+    arena_size = size;
+    return 1;
+}
+
+/*
+ * band:
+ * an auxiliary function
+ * saves in "first" and "last" the range of the "count" rows (or
+ * columns) that belongs to part "part" of "parts".
+ */
+static void band(int count, int part, int parts, int *first, int *last){
+    *first = (int)((long)count * part / parts);
+    *last = (int)((long)count * (part + 1) / parts);
+}
+
+/*
+ * pack:
+ * an auxiliary function
+ * copies the block of "m" in rows first_row to last_row - 1 and
+ * columns first_col to last_col - 1 to "packed", stored there by rows,
+ * multiplied by "scale" (zero is written rather than multiplied, like
+ * in "mat_gemm").
+ */
+static void pack(const mat_t *m, float *packed, int first_row, int last_row, int first_col, int last_col, float scale){
+    int i, j;
+    for(i = first_row; i < last_row; i++){
+        for(j = first_col; j < last_col; j++)
+            *packed++ = scale == 0.0f ? 0.0f : scale * AT(m, i, j);
+    }
+}
+
+/*
+ * unpack:
+ * an auxiliary function
+ * the opposite of "pack" (without scaling).
+ */
+static void unpack(mat_t *m, const float *packed, int first_row, int last_row, int first_col, int last_col){
+    int i, j;
+    for(i = first_row; i < last_row; i++){
+        for(j = first_col; j < last_col; j++)
+            AT(m, i, j) = *packed++;
+    }
+}
+
+/*
+ * grid_gemm:
+ * c = alpha * a * b + beta * c on the grid, the operands must not
+ * overlap. c is split in grid_rows x (grid_count / grid_rows) blocks,
+ * one per worker. the coordinator scatters a in bands of rows, b in
+ * bands of columns and beta * c in blocks into the arena, every worker
+ * adds its part of the product to its block there, in the same order
+ * as "gemm_kernel" (so the result is the same as without the grid),
+ * then the coordinator gathers the blocks into c. returns 0 and leaves
+ * c untouched if the product is too small for the grid, the grid is
+ * not running or busy, or a worker failed (which stops the grid), in
+ * which case the caller computes the product itself.
+ */
+int grid_gemm(mat_t *c, const mat_t *a, const mat_t *b, float alpha, float beta){
+    grid_job job;
+    long b_offset, c_offset;
+    int grid_cols, worker, first_row, last_row, first_col, last_col, ok = 1;
+    char done;
+    if ((double)c->rows * c->cols * a->cols < GRID_MIN_WORK || pthread_mutex_trylock(&grid_lock))
+        return 0;
+    b_offset = (long)a->rows * a->cols;
+    c_offset = b_offset + (long)b->rows * b->cols;
+    if (grid_count == 0 || !grow_arena((c_offset + (long)c->rows * c->cols) * sizeof(float))){
+        pthread_mutex_unlock(&grid_lock);
+        return 0;
+    }
+    grid_cols = grid_count / grid_rows;
+    pack(a, arena, 0, a->rows, 0, a->cols, 1.0f);
+    for(worker = 0; worker < grid_cols; worker++){
+        band(b->cols, worker, grid_cols, &first_col, &last_col);
+        pack(b, arena + b_offset + (long)b->rows * first_col, 0, b->rows, first_col, last_col, 1.0f);
+    }
+    for(worker = 0; worker < grid_count; worker++){
+        band(c->rows, worker / grid_cols, grid_rows, &first_row, &last_row);
+        band(c->cols, worker % grid_cols, grid_cols, &first_col, &last_col);
+        job.arena_size = arena_size;
+        job.rows = last_row - first_row;
+        job.cols = last_col - first_col;
+        job.depth = a->cols;
+        job.alpha = alpha;
+        job.a = (long)first_row * a->cols;
+        job.b = b_offset + (long)b->rows * first_col;
+        job.c = c_offset + (long)first_row * c->cols + (long)job.rows * first_col;
+        pack(c, arena + job.c, first_row, last_row, first_col, last_col, beta);
+        ok = transfer(sockets[worker], &job, sizeof(job), 1) && ok;
+    }
+    for(worker = 0; worker < grid_count; worker++)
+        ok = transfer(sockets[worker], &done, 1, 0) && ok;
+    if (!ok){
+        stop_grid();
+        pthread_mutex_unlock(&grid_lock);
+        return 0;
+    }
+    for(worker = 0; worker < grid_count; worker++){
+        band(c->rows, worker / grid_cols, grid_rows, &first_row, &last_row);
+        band(c->cols, worker % grid_cols, grid_cols, &first_col, &last_col);
+        unpack(c, arena + c_offset + (long)first_row * c->cols + (long)(last_row - first_row) * first_col,
+                first_row, last_row, first_col, last_col);
+    }
+    pthread_mutex_unlock(&grid_lock);
+    return 1;
+}
@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <float.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+/*
+ * the rows are processed in tiles of at most MAP_TILE elements, kept
+ * on the stack while every step of the chain runs over them.
+ */
+#define MAP_TILE 256
+
+/*
+ * how the operand of a step lines up with the input: element by
+ * element, one row repeated down all the rows, one column repeated
+ * across all the columns, or one element repeated everywhere.
+ */
+#define SPREAD_NONE 0
+#define SPREAD_FULL 1
+#define SPREAD_ROW 2
+#define SPREAD_COL 3
+#define SPREAD_ONE 4
+
+/*
+ * the range of the arguments of "exp_tile": EXP_MAX is the largest
+ * float whose exp is finite (just below ln FLT_MAX), EXP_MIN the
+ * smallest whose exp doesn't round to 0 (ln 2 ^ -150, the results
+ * below ln FLT_MIN are subnormal). above the range the result is
+ * infinity, below it 0.
+ */
+#define EXP_MAX 88.7228317f
+#define EXP_MIN -103.972077f
+#define LOG2E 1.44269504088896341f
+#define LN2_HI 0.693359375f
+#define LN2_LO -2.12194440e-4f
+
+/*
+ * map_args:
+ * the arguments of a chain of steps split by rows among the pool
+ * threads, "spread" holds the SPREAD_ kind of the operand of each step.
+ */
+typedef struct map_args {
+    mat_t *c;
+    const mat_t *a;
+    const mat_map_step *steps;
+    const int *spread;
+    int count;
+} map_args;
+
+/*
+ * spread_of:
+ * an auxiliary function
+ * returns the SPREAD_ kind of "operand" against the rows x cols input,
+ * SPREAD_NONE if its shape doesn't fit.
+ */
+static int spread_of(const mat_t *operand, int rows, int cols){
+    if (operand->rows == rows && operand->cols == cols)
+        return SPREAD_FULL;
+    if (operand->rows == 1 && operand->cols == cols)
+        return SPREAD_ROW;
+    if (operand->rows == rows && operand->cols == 1)
+        return SPREAD_COL;
+    if (operand->rows == 1 && operand->cols == 1)
+        return SPREAD_ONE;
+    return SPREAD_NONE;
+}
+
+/*
+ * exp_tile:
+ * an auxiliary function
+ * t[j] = e ^ t[j] for the n elements of the tile, without calling
+ * "exp": x = k * ln 2 + f, with |f| <= ln 2 / 2, e ^ f is a polynomial
+ * (that of the Cephes library, within 2 ulp) and 2 ^ k is put in the
+ * exponent bits of two factors, 2 ^ (k / 2) and 2 ^ (k - k / 2), so
+ * neither overflows at the top of the range (k = 128) nor is subnormal
+ * at the bottom (k = -150). each pass over the tile is a loop without
+ * branches, so the compiler may vectorize it, the arguments are clamped
+ * to the range first, and the results of those beyond it (and not a
+ * number, which stays so) are fixed last.
+ */
+static void exp_tile(float *t, int n){
+    union {
+        float f;
+        unsigned int u;
+    } scale, rest;
+    float x[MAP_TILE], f, p;
+    int j, k;
+    for(j = 0; j < n; j++){
+        x[j] = t[j] < EXP_MAX ? t[j] : EXP_MAX;
+        x[j] = x[j] > EXP_MIN ? x[j] : EXP_MIN;
+    }
+    for(j = 0; j < n; j++){
+        k = (int)(x[j] * LOG2E + 256.5f) - 256;
+        f = x[j] - k * LN2_HI - k * LN2_LO;
+        p = 1.9875691500e-4f;
+        p = p * f + 1.3981999507e-3f;
+        p = p * f + 8.3334519073e-3f;
+        p = p * f + 4.1665795894e-2f;
+        p = p * f + 1.6666665459e-1f;
+        p = p * f + 5.0000001201e-1f;
+        p = p * f * f + f + 1.0f;
+        scale.u = (unsigned int)(k / 2 + 127) << 23;
+        rest.u = (unsigned int)(k - k / 2 + 127) << 23;
+        x[j] = p * scale.f * rest.f;
+    }
+    for(j = 0; j < n; j++){
+        x[j] = t[j] < EXP_MIN ? 0.0f : x[j];
+        x[j] = t[j] > EXP_MAX ? t[j] * FLT_MAX : x[j];
+        t[j] = t[j] == t[j] ? x[j] : t[j];
+    }
+}
+
+/*
+ * apply:
+ * an auxiliary function
+ * runs "step" over the tile t of n elements, the elements j0 to
+ * j0 + n - 1 of row i. the operand is either a vector "v" (stride
+ * "s") lined up with the tile, or the single value "x".
+ */
+static void apply(const mat_map_step *step, int spread, float *t, int n, int i, int j0){
+    const float *v = NULL;
+    float x = step->scalar;
+    long s = 0;
+    int j;
+    if (spread == SPREAD_FULL || spread == SPREAD_ROW){
+        v = &AT(step->operand, spread == SPREAD_FULL ? i : 0, j0);
+        s = step->operand->cs;
+    }
+    else if (spread == SPREAD_COL)
+        x = AT(step->operand, i, 0);
+    else if (spread == SPREAD_ONE)
+        x = AT(step->operand, 0, 0);
+    switch(step->op){
+        case MAT_MAP_ADD:
+            if (v != NULL)
+                for(j = 0; j < n; j++)
+                    t[j] += v[j * s];
+            else
+                for(j = 0; j < n; j++)
+                    t[j] += x;
+            break;
+        case MAT_MAP_SUB:
+            if (v != NULL)
+                for(j = 0; j < n; j++)
+                    t[j] -= v[j * s];
+            else
+                for(j = 0; j < n; j++)
+                    t[j] -= x;
+            break;
+        case MAT_MAP_MUL:
+            if (v != NULL)
+                for(j = 0; j < n; j++)
+                    t[j] *= v[j * s];
+            else
+                for(j = 0; j < n; j++)
+                    t[j] *= x;
+            break;
+        case MAT_MAP_DIV:
+            if (v != NULL)
+                for(j = 0; j < n; j++)
+                    t[j] /= v[j * s];
+            else
+                for(j = 0; j < n; j++)
+                    t[j] /= x;
+            break;
+        case MAT_MAP_EXP:
+            exp_tile(t, n);
+            break;
+        case MAT_MAP_RELU:
+            for(j = 0; j < n; j++)
+                t[j] = t[j] > 0.0f ? t[j] : 0.0f;
+            break;
+        case MAT_MAP_CLAMP:
+            for(j = 0; j < n; j++){
+                t[j] = t[j] < step->scalar ? step->scalar : t[j];
+                t[j] = t[j] > step->limit ? step->limit : t[j];
+            }
+            break;
+    }
+}
+
+/*
+ * map_part:
+ * an auxiliary function
+ * the pool task of "mat_map": runs the whole chain over a band of rows,
+ * a tile at a time, so every element is read and written once.
+ */
+static void map_part(void *arg, int part, int parts){
+    map_args *args = arg;
+    float t[MAP_TILE];
+    int first = (int)((long)args->c->rows * part / parts), last = (int)((long)args->c->rows * (part + 1) / parts);
+    int i, j, j0, n, k;
+    for(i = first; i < last; i++){
+        for(j0 = 0; j0 < args->c->cols; j0 += MAP_TILE){
+            n = args->c->cols - j0 < MAP_TILE ? args->c->cols - j0 : MAP_TILE;
+            for(j = 0; j < n; j++)
+                t[j] = AT(args->a, i, j0 + j);
+            for(k = 0; k < args->count; k++)
+                apply(&args->steps[k], args->spread[k], t, n, i, j0);
+            for(j = 0; j < n; j++)
+                AT(args->c, i, j0 + j) = t[j];
+        }
+    }
+}
+
+/*
+ * mat_map:
+ * c = the chain of "count" steps applied to a, element by element, in
+ * a single pass over the matrices (see "mat_map_step"). c must have the
+ * shape of a, and may be a itself. the operands of the steps have the
+ * shape of a, or are a row, a column or a single element repeated over
+ * it. the output is formed in a temporary matrix if it overlaps an
+ * operand or a in any other way. the rows are split among the pool
+ * threads.
+ */
+mat_status mat_map(mat_t *c, const mat_t *a, const mat_map_step *steps, int count){
+    map_args args;
+    mat_t *temp;
+    mat_status status;
+    int *spread, k, overlap;
+    if (c->rows != a->rows || c->cols != a->cols || count < 0)
+        return MAT_ERR_SHAPE;
+    if ((spread = malloc((count > 0 ? count : 1) * sizeof(int))) == NULL)
+        return MAT_ERR_ALLOC;
+    overlap = may_overlap(c, a) && !(c->base == a->base && c->rs == a->rs && c->cs == a->cs);
+    for(k = 0, status = MAT_OK; k < count && status == MAT_OK; k++){
+        spread[k] = SPREAD_NONE;
+        if (steps[k].op == MAT_MAP_CLAMP && steps[k].scalar > steps[k].limit)
+            status = MAT_ERR_RANGE;
+        else if (steps[k].op > MAT_MAP_DIV || steps[k].operand == NULL)
+            continue;
+        else if ((spread[k] = spread_of(steps[k].operand, a->rows, a->cols)) == SPREAD_NONE)
+            status = MAT_ERR_SHAPE;
+        else if (may_overlap(c, steps[k].operand) && (spread[k] != SPREAD_FULL || c->base != steps[k].operand->base
+                                                      || c->rs != steps[k].operand->rs || c->cs != steps[k].operand->cs))
+            overlap = 1;
+    }
+    if (status == MAT_OK && overlap){
+        if ((temp = mat_create(c->rows, c->cols)) == NULL)
+            status = MAT_ERR_ALLOC;
+        else if ((status = mat_map(temp, a, steps, count)) == MAT_OK)
+            status = mat_copy(c, temp);
+        mat_free(temp);
+    }
+    else if (status == MAT_OK){
+        args.c = c;
+        args.a = a;
+        args.steps = steps;
+        args.spread = spread;
+        args.count = count;
+        pool_run(map_part, &args, pool_parts((double)c->rows * c->cols * (count + 1), c->rows));
+        mark_written(c);
+    }
+    free(spread);
+    return status;
+}
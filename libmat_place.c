@@ -0,0 +1,162 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+/*
+ * buffers of at least PLACE_MIN_BYTES are mapped (in whole huge pages
+ * of HUGE_PAGE_SIZE) and placed, smaller ones come from the heap.
+ */
+#define HUGE_PAGE_SIZE (2L << 20)
+#define PLACE_MIN_BYTES HUGE_PAGE_SIZE
+
+/*
+ * the memory policy numbers of the Linux system calls, as in <numaif.h>
+ * which is not installed everywhere.
+ */
+#define MPOL_INTERLEAVE 3
+#define MPOL_F_MEMS_ALLOWED (1 << 2)
+#define MAX_NODES 1024
+
+/*
+ * placement:
+ * the placement of the matrices created by "mat_create", guarded by
+ * "placement_lock".
+ */
+static mat_placement placement = MAT_PLACE_LOCAL;
+static pthread_mutex_t placement_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * mat_set_placement:
+ * sets the placement of the storage of the matrices "mat_create" makes
+ * from now on, see "mat_placement".
+ */
+void mat_set_placement(mat_placement kind){
+    pthread_mutex_lock(&placement_lock);
+    placement = kind;
+    pthread_mutex_unlock(&placement_lock);
+}
+
+/*
+ * default_placement:
+ * returns the placement set by "mat_set_placement".
+ */
+mat_placement default_placement(void){
+    mat_placement kind;
+    pthread_mutex_lock(&placement_lock);
+    kind = placement;
+    pthread_mutex_unlock(&placement_lock);
+    return kind;
+}
+
+/*
+ * interleave:
+ * an auxiliary function
+ * asks the kernel to spread the pages of the "size" bytes at "mem"
+ * round robin over the memory nodes the process may use, before they
+ * are touched. nothing happens where that can't be done.
+ */
+static void interleave(void *mem, size_t size){
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+    unsigned long nodes[MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(nodes, 0, sizeof(nodes));
+    if (syscall(SYS_get_mempolicy, NULL, nodes, (unsigned long)MAX_NODES, NULL, (unsigned long)MPOL_F_MEMS_ALLOWED) == 0)
+        syscall(SYS_mbind, mem, (unsigned long)size, MPOL_INTERLEAVE, nodes, (unsigned long)MAX_NODES, 0UL);
+#else
+    (void)mem;
+    (void)size;
+#endif
+}
+
+/*
+ * touch_args:
+ * the matrix "place_alloc" zeroes on the pool threads.
+ */
+typedef struct touch_args {
+    float *data;
+    int rows;
+    int cols;
+} touch_args;
+
+/*
+ * touch_part:
+ * an auxiliary function
+ * the pool task of "place_alloc": zeroes a band of rows, so its pages
+ * are allocated on the memory node of the thread that runs the part.
+ */
+static void touch_part(void *arg, int part, int parts){
+    touch_args *args = arg;
+    long first = (long)args->rows * part / parts, last = (long)args->rows * (part + 1) / parts;
+    memset(args->data + first * args->cols, 0, (size_t)(last - first) * args->cols * sizeof(float));
+}
+
+/*
+ * map:
+ * an auxiliary function
+ * maps "size" bytes of anonymous memory, from the reserved huge pages
+ * if there are any, returns NULL on failure.
+ */
+static void *map(size_t size){
+    void *mem = MAP_FAILED;
+#ifndef MAP_ANONYMOUS
+    return NULL;
+#else
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mem == MAP_FAILED)
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    return mem;
+#endif
+}
+
+/*
+ * place_alloc:
+ * allocates the zeroed storage of a rows x cols matrix placed as "kind"
+ * says, saves in "mapped" the size of the mapping to give to
+ * "place_free" (0 for heap storage). returns NULL on failure.
+ */
+float *place_alloc(int rows, int cols, mat_placement kind, size_t *mapped){
+    size_t size = (size_t)rows * cols * sizeof(float);
+    touch_args args;
+    float *data;
+    *mapped = 0;
+    if (size < PLACE_MIN_BYTES)
+        return calloc((size_t)rows * cols, sizeof(float));
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if ((data = map(size)) == NULL)
+        return calloc((size_t)rows * cols, sizeof(float));
+    *mapped = size;
+    if (kind == MAT_PLACE_INTERLEAVE)
+        interleave(data, size);
+    else if (kind == MAT_PLACE_PARTITION){
+        args.data = data;
+        args.rows = rows;
+        args.cols = cols;
+        pool_run(touch_part, &args, rows < pool_threads() ? rows : pool_threads());
+    }
+    return data;
+}
+
+/*
+ * place_free:
+ * frees storage allocated by "place_alloc".
+ */
+void place_free(float *data, size_t mapped){
+    if (mapped)
+        munmap(data, mapped);
+    else
+        free(data);
+}
@@ -0,0 +1,263 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <pthread.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+#define POOL_MIN_WORK (1L << 20)
+#define PLACED_MAX 32
+
+/*
+ * pool_job:
+ * a call of "pool_run" in progress: "task" is run once for every part
+ * of "parts", "next" counts the parts claimed so far (and is the next
+ * one to claim) and "finished" the parts done. a "placed" job has a
+ * part for every thread, part i runs on pool thread i (0 being the
+ * caller), "taken" has bit i set once it's claimed. jobs with
+ * unclaimed parts are queued on "link", oldest first.
+ */
+typedef struct pool_job {
+    pool_task task;
+    void *arg;
+    int parts;
+    int next;
+    int finished;
+    int placed;
+    unsigned long taken;
+    struct pool_job *link;
+} pool_job;
+
+/*
+ * the pool: "workers" threads waiting for parts of the queued jobs, all
+ * of this is guarded by "pool_lock". the pool is shared by every thread
+ * using the library, so concurrent callers split the same workers.
+ */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static pool_job *queue;
+static pthread_t *workers;
+static int worker_count, stopping, pin_step;
+
+/*
+ * available:
+ * an auxiliary function
+ * returns 1 if pool thread "self" may claim a part of "job".
+ */
+static int available(const pool_job *job, int self){
+    return !job->placed || !(job->taken & (1UL << self));
+}
+
+/*
+ * claim:
+ * an auxiliary function
+ * returns the next part of "job" for pool thread "self" and dequeues
+ * the job once all its parts are claimed, "pool_lock" must be held.
+ */
+static int claim(pool_job *job, int self){
+    pool_job **link;
+    int part = job->placed ? self : job->next;
+    job->next++;
+    job->taken |= job->placed ? 1UL << self : 0;
+    if (job->next == job->parts){
+        for(link = &queue; *link != job; link = &(*link)->link)
+            ;
+        *link = job->link;
+    }
+    return part;
+}
+
+/*
+ * find_job:
+ * an auxiliary function
+ * returns the oldest queued job with a part for pool thread "self",
+ * NULL if there is none, "pool_lock" must be held.
+ */
+static pool_job *find_job(int self){
+    pool_job *job;
+    for(job = queue; job != NULL && !available(job, self); job = job->link)
+        ;
+    return job;
+}
+
+/*
+ * pin:
+ * an auxiliary function
+ * binds pool thread "self" to CPU self * pin_step (wrapping around the
+ * online CPUs), if "mat_pool_pin" asked for it. only Linux can do it.
+ */
+static void pin(int self){
+#ifdef __linux__
+    cpu_set_t cpus;
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (pin_step <= 0 || count <= 0)
+        return;
+    CPU_ZERO(&cpus);
+    CPU_SET((int)((long)self * pin_step % count), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+/*
+ * worker:
+ * an auxiliary function
+ * the body of pool thread number "self" (from 1, the caller of
+ * "pool_run" is 0), runs parts of the oldest queued job it may take
+ * until the pool is stopped.
+ */
+static void *worker(void *self){
+    pool_job *job;
+    int part, index = (int)(long)self;
+    pin(index);
+    pthread_mutex_lock(&pool_lock);
+    while(1){
+        while(!stopping && (job = find_job(index)) == NULL)
+            pthread_cond_wait(&work_ready, &pool_lock);
+        if (stopping)
+            break;
+        part = claim(job, index);
+        pthread_mutex_unlock(&pool_lock);
+        job->task(job->arg, part, job->parts);
+        pthread_mutex_lock(&pool_lock);
+        if (++job->finished == job->parts)
+            pthread_cond_broadcast(&work_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+/*
+ * mat_pool_start:
+ * starts "threads" pool threads, the operations split large enough
+ * work among them and the calling thread. a pool that is already
+ * running is stopped first, 0 threads leaves it stopped. returns
+ * MAT_ERR_ALLOC if the threads could not be created.
+ */
+mat_status mat_pool_start(int threads){
+    int i;
+    mat_pool_stop();
+    if (threads <= 0)
+        return MAT_OK;
+    if ((workers = malloc(threads * sizeof(pthread_t))) == NULL)
+        return MAT_ERR_ALLOC;
+    for(i = 0; i < threads; i++){
+        if (pthread_create(&workers[i], NULL, worker, (void *)(long)(i + 1)))
+            break;
+        worker_count++;
+    }
+    if (i < threads){
+        mat_pool_stop();
+        return MAT_ERR_ALLOC;
+    }
+    return MAT_OK;
+}
+
+/*
+ * mat_pool_stop:
+ * stops the pool threads, no operation may be running meanwhile.
+ */
+void mat_pool_stop(void){
+    int i;
+    pthread_mutex_lock(&pool_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+    for(i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    stopping = 0;
+}
+
+/*
+ * mat_pool_pin:
+ * pool threads started afterwards are bound to a CPU each, thread i to
+ * CPU i * step (modulo the number of CPUs), so "step" 1 packs them on
+ * neighbouring CPUs and a larger one spreads them across the sockets.
+ * 0 (the default) leaves them to the scheduler, as does any system
+ * other than Linux.
+ */
+void mat_pool_pin(int step){
+    pthread_mutex_lock(&pool_lock);
+    pin_step = step;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * pool_threads:
+ * returns the number of threads that run the parts of a job, the pool
+ * threads and the caller.
+ */
+int pool_threads(void){
+    int threads;
+    pthread_mutex_lock(&pool_lock);
+    threads = worker_count + 1;
+    pthread_mutex_unlock(&pool_lock);
+    return threads;
+}
+
+/*
+ * pool_parts:
+ * returns how many parts "work" (in multiply-adds or so) should be
+ * split into, at most "max": one per pool thread and one for the
+ * caller, but no part smaller than POOL_MIN_WORK.
+ */
+int pool_parts(double work, int max){
+    int parts;
+    pthread_mutex_lock(&pool_lock);
+    parts = worker_count + 1;
+    pthread_mutex_unlock(&pool_lock);
+    if (work / POOL_MIN_WORK < parts)
+        parts = (int)(work / POOL_MIN_WORK);
+    if (parts > max)
+        parts = max;
+    return parts > 1 ? parts : 1;
+}
+
+/*
+ * pool_run:
+ * runs task(arg, part, parts) for every part of "parts" on the pool
+ * threads and the calling thread, returns when all of them are done.
+ * without a pool the parts simply run one after the other. a job with
+ * exactly a part per thread always runs part i on thread i, so the
+ * same band of a matrix goes to the same thread (and CPU, if pinned)
+ * in every operation, the band it touched first (see "place_alloc").
+ */
+void pool_run(pool_task task, void *arg, int parts){
+    pool_job job, **tail;
+    int part;
+    job.task = task;
+    job.arg = arg;
+    job.parts = parts;
+    job.next = 0;
+    job.finished = 0;
+    job.taken = 0;
+    job.link = NULL;
+    pthread_mutex_lock(&pool_lock);
+    if (worker_count == 0 || parts <= 1){
+        pthread_mutex_unlock(&pool_lock);
+        for(part = 0; part < parts; part++)
+            task(arg, part, parts);
+        return;
+    }
+    job.placed = parts == worker_count + 1 && parts <= PLACED_MAX;
+    for(tail = &queue; *tail != NULL; tail = &(*tail)->link)
+        ;
+    *tail = &job;
+    pthread_cond_broadcast(&work_ready);
+    while(job.next < parts && available(&job, 0)){
+        part = claim(&job, 0);
+        pthread_mutex_unlock(&pool_lock);
+        task(arg, part, parts);
+        pthread_mutex_lock(&pool_lock);
+        job.finished++;
+    }
+    while(job.finished < parts)
+        pthread_cond_wait(&work_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
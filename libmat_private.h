@@ -0,0 +1,71 @@
+#ifndef LIBMAT_PRIVATE_H
+#define LIBMAT_PRIVATE_H
+
+/*
+ * the layout of the handles of "libmat.h", shared by the source files
+ * of the library only, programs using the library never see it.
+ */
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * mat_buf:
+ * the storage shared by a matrix and all of its views, "ld" is the
+ * row length of the matrix that created it, "mapped" and "placement"
+ * describe how it was allocated (see "place_alloc"), "version" is
+ * bumped by every write to any of its handles, "refs" counts the
+ * handles that point to it. the two counters are guarded by "lock", so
+ * handles sharing a buffer may be written and freed from different
+ * threads.
+ */
+typedef struct mat_buf {
+    float *data;
+    long ld;
+    size_t mapped;
+    mat_placement placement;
+    unsigned long version;
+    int refs;
+    pthread_mutex_t lock;
+} mat_buf;
+
+/*
+ * mat_t:
+ * rows and cols are the extent of the handle, element (i, j) is stored
+ * at base[i * rs + j * cs]: an owned matrix has rs = cols and cs = 1,
+ * a view moves base to its corner and multiplies the strides of its
+ * parent by its steps, a transposed view swaps rs and cs. "id" is
+ * unique to the handle, no two handles ever get the same one.
+ */
+struct mat_t {
+    unsigned long id;
+    mat_buf *buf;
+    float *base;
+    int rows;
+    int cols;
+    long rs;
+    long cs;
+    int is_view;
+};
+
+#define AT(m, i, j) ((m)->base[(long)(i) * (m)->rs + (long)(j) * (m)->cs])
+
+/*
+ * pool_task:
+ * a part of an operation split by "pool_run", called with the argument
+ * given to "pool_run", the index of the part and the number of parts.
+ */
+typedef void (*pool_task)(void *, int, int);
+
+void mark_written(mat_t *);
+int may_overlap(const mat_t *, const mat_t *);
+void gemm_kernel(mat_t *, const mat_t *, const mat_t *, float);
+int grid_gemm(mat_t *, const mat_t *, const mat_t *, float, float);
+int pool_threads(void);
+int pool_parts(double, int);
+void pool_run(pool_task, void *, int);
+mat_placement default_placement(void);
+float *place_alloc(int, int, mat_placement, size_t *);
+void place_free(float *, size_t);
+
+#endif
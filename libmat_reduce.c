@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <math.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+#define PAIRWISE_BLOCK 128
+
+/*
+ * what is summed by the reductions: the elements, their absolute
+ * values or their squares.
+ */
+#define REDUCE_SUM 0
+#define REDUCE_ABS 1
+#define REDUCE_SQUARE 2
+
+/*
+ * pairwise:
+ * an auxiliary function
+ * sums "op" of the n elements x[0], x[stride], ... by pairwise
+ * summation: halves are summed separately and then added, down to
+ * blocks of PAIRWISE_BLOCK, which are summed in four independent
+ * double accumulators (that the compiler may vectorize), so the error
+ * grows with log(n) rather than n.
+ */
+static double pairwise(const float *x, long n, long stride, int op){
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    long k, half;
+    if (n > PAIRWISE_BLOCK){
+        half = n / 2;
+        return pairwise(x, half, stride, op) + pairwise(x + half * stride, n - half, stride, op);
+    }
+    if (op == REDUCE_SUM){
+        for(k = 0; k + 4 <= n; k += 4){
+            s0 += x[k * stride];
+            s1 += x[(k + 1) * stride];
+            s2 += x[(k + 2) * stride];
+            s3 += x[(k + 3) * stride];
+        }
+        for(; k < n; k++)
+            s0 += x[k * stride];
+    }
+    else if (op == REDUCE_ABS){
+        for(k = 0; k + 4 <= n; k += 4){
+            s0 += fabs(x[k * stride]);
+            s1 += fabs(x[(k + 1) * stride]);
+            s2 += fabs(x[(k + 2) * stride]);
+            s3 += fabs(x[(k + 3) * stride]);
+        }
+        for(; k < n; k++)
+            s0 += fabs(x[k * stride]);
+    }
+    else {
+        for(k = 0; k + 4 <= n; k += 4){
+            s0 += (double)x[k * stride] * x[k * stride];
+            s1 += (double)x[(k + 1) * stride] * x[(k + 1) * stride];
+            s2 += (double)x[(k + 2) * stride] * x[(k + 2) * stride];
+            s3 += (double)x[(k + 3) * stride] * x[(k + 3) * stride];
+        }
+        for(; k < n; k++)
+            s0 += (double)x[k * stride] * x[k * stride];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/*
+ * reduce_args:
+ * the arguments of a reduction split among the pool threads: "op" of
+ * the elements of "a" is summed by rows (or by columns), each row
+ * (column) sum is saved in "out" unless it's NULL, and the row sums
+ * of each part are added up, or their maximum taken if "take_max" is
+ * set, into partials[part]. "sums" holds the column sums.
+ */
+typedef struct reduce_args {
+    const mat_t *a;
+    mat_t *out;
+    int op;
+    int take_max;
+    double *partials;
+    double *sums;
+} reduce_args;
+
+/*
+ * band:
+ * an auxiliary function
+ * saves in "first" and "last" the range of the "count" rows (or
+ * columns) that belongs to part "part" of "parts".
+ */
+static void band(int count, int part, int parts, int *first, int *last){
+    *first = (int)((long)count * part / parts);
+    *last = (int)((long)count * (part + 1) / parts);
+}
+
+/*
+ * row_part:
+ * an auxiliary function
+ * the pool task of "reduce" by rows.
+ */
+static void row_part(void *arg, int part, int parts){
+    reduce_args *args = arg;
+    const mat_t *a = args->a;
+    double total = 0.0, row;
+    int i, first, last;
+    band(a->rows, part, parts, &first, &last);
+    for(i = first; i < last; i++){
+        row = pairwise(&AT(a, i, 0), a->cols, a->cs, args->op);
+        if (args->out != NULL)
+            AT(args->out, i, 0) = (float)row;
+        if (!args->take_max)
+            total += row;
+        else if (row > total)
+            total = row;
+    }
+    args->partials[part] = total;
+}
+
+/*
+ * column_part:
+ * an auxiliary function
+ * the pool task of "reduce" by columns: a band of columns is summed down
+ * the rows, a row at a time, in double accumulators.
+ */
+static void column_part(void *arg, int part, int parts){
+    reduce_args *args = arg;
+    const mat_t *a = args->a;
+    double total = 0.0, *sums = args->sums;
+    const float *row;
+    int i, j, first, last;
+    band(a->cols, part, parts, &first, &last);
+    for(j = first; j < last; j++)
+        sums[j] = 0.0;
+    for(i = 0; i < a->rows; i++){
+        row = &AT(a, i, 0);
+        if (args->op == REDUCE_ABS){
+            for(j = first; j < last; j++)
+                sums[j] += fabs(row[j * a->cs]);
+        }
+        else {
+            for(j = first; j < last; j++)
+                sums[j] += row[j * a->cs];
+        }
+    }
+    for(j = first; j < last; j++){
+        if (args->out != NULL)
+            AT(args->out, 0, j) = (float)sums[j];
+        if (!args->take_max)
+            total += sums[j];
+        else if (sums[j] > total)
+            total = sums[j];
+    }
+    args->partials[part] = total;
+}
+
+/*
+ * reduce:
+ * an auxiliary function
+ * runs "task" (row_part or column_part) over "count" rows or columns
+ * of "a" on the pool, then combines the partial results of the parts
+ * in order into "result", see "reduce_args" for the rest.
+ */
+static mat_status reduce(pool_task task, int count, const mat_t *a, mat_t *out, int op, int take_max, double *result){
+    reduce_args args;
+    int part, parts = pool_parts((double)a->rows * a->cols, count);
+    args.a = a;
+    args.out = out;
+    args.op = op;
+    args.take_max = take_max;
+    args.partials = malloc(parts * sizeof(double));
+    args.sums = task == column_part ? malloc(a->cols * sizeof(double)) : NULL;
+    if (args.partials == NULL || (task == column_part && args.sums == NULL)){
+        free(args.partials);
+        free(args.sums);
+        return MAT_ERR_ALLOC;
+    }
+    pool_run(task, &args, parts);
+    for(*result = 0.0, part = 0; part < parts; part++){
+        if (!take_max)
+            *result += args.partials[part];
+        else if (args.partials[part] > *result)
+            *result = args.partials[part];
+    }
+    free(args.partials);
+    free(args.sums);
+    return MAT_OK;
+}
+
+/*
+ * mat_sum:
+ * saves the sum of the elements of "a" in "sum".
+ */
+mat_status mat_sum(const mat_t *a, float *sum){
+    double result;
+    mat_status status = reduce(row_part, a->rows, a, NULL, REDUCE_SUM, 0, &result);
+    if (status == MAT_OK)
+        *sum = (float)result;
+    return status;
+}
+
+/*
+ * mat_norm:
+ * saves the norm of "a" of the kind "kind" in "norm": the Frobenius
+ * norm (the square root of the sum of the squares of the elements),
+ * the 1 norm (the largest sum of absolute values of a column) or the
+ * infinity norm (the same for the rows).
+ */
+mat_status mat_norm(const mat_t *a, mat_norm_kind kind, float *norm){
+    double result;
+    mat_status status;
+    if (kind == MAT_NORM_ONE)
+        status = reduce(column_part, a->cols, a, NULL, REDUCE_ABS, 1, &result);
+    else if (kind == MAT_NORM_INF)
+        status = reduce(row_part, a->rows, a, NULL, REDUCE_ABS, 1, &result);
+    else {
+        status = reduce(row_part, a->rows, a, NULL, REDUCE_SQUARE, 0, &result);
+        result = sqrt(result);
+    }
+    if (status == MAT_OK)
+        *norm = (float)result;
+    return status;
+}
+
+/*
+ * mat_trace:
+ * saves the sum of the diagonal of the square matrix "a" in "trace".
+ */
+mat_status mat_trace(const mat_t *a, float *trace){
+    if (a->rows != a->cols)
+        return MAT_ERR_SHAPE;
+    *trace = (float)pairwise(a->base, a->rows, a->rs + a->cs, REDUCE_SUM);
+    return MAT_OK;
+}
+
+/*
+ * minmax_args:
+ * the arguments of "mat_minmax" split among the pool threads, the
+ * extremes of each part are saved in mins[part] and maxs[part].
+ */
+typedef struct minmax_args {
+    const mat_t *a;
+    float *mins, *maxs;
+} minmax_args;
+
+/*
+ * minmax_part:
+ * an auxiliary function
+ * the pool task of "mat_minmax", a band of rows.
+ */
+static void minmax_part(void *arg, int part, int parts){
+    minmax_args *args = arg;
+    const mat_t *a = args->a;
+    float low, high, x;
+    const float *row;
+    int i, j, first, last;
+    band(a->rows, part, parts, &first, &last);
+    low = high = AT(a, first, 0);
+    for(i = first; i < last; i++){
+        row = &AT(a, i, 0);
+        for(j = 0; j < a->cols; j++){
+            x = row[j * a->cs];
+            low = x < low ? x : low;
+            high = x > high ? x : high;
+        }
+    }
+    args->mins[part] = low;
+    args->maxs[part] = high;
+}
+
+/*
+ * mat_minmax:
+ * saves the smallest and the largest element of "a" in "min" and "max".
+ */
+mat_status mat_minmax(const mat_t *a, float *min, float *max){
+    minmax_args args;
+    int part, parts = pool_parts((double)a->rows * a->cols, a->rows);
+    args.a = a;
+    args.mins = malloc(parts * sizeof(float));
+    args.maxs = malloc(parts * sizeof(float));
+    if (args.mins == NULL || args.maxs == NULL){
+        free(args.mins);
+        free(args.maxs);
+        return MAT_ERR_ALLOC;
+    }
+    pool_run(minmax_part, &args, parts);
+    *min = args.mins[0];
+    *max = args.maxs[0];
+    for(part = 1; part < parts; part++){
+        *min = args.mins[part] < *min ? args.mins[part] : *min;
+        *max = args.maxs[part] > *max ? args.maxs[part] : *max;
+    }
+    free(args.mins);
+    free(args.maxs);
+    return MAT_OK;
+}
+
+/*
+ * sums:
+ * an auxiliary function
+ * the common body of "mat_row_sums" and "mat_col_sums": checks "out"
+ * has the shape of the result, and forms the sums in a temporary
+ * matrix if it shares storage with "a".
+ */
+static mat_status sums(mat_t *out, const mat_t *a, int by_rows){
+    mat_t *temp;
+    mat_status status;
+    double total;
+    if (by_rows ? out->rows != a->rows || out->cols != 1 : out->rows != 1 || out->cols != a->cols)
+        return MAT_ERR_SHAPE;
+    if (may_overlap(out, a)){
+        if ((temp = mat_create(out->rows, out->cols)) == NULL)
+            return MAT_ERR_ALLOC;
+        if ((status = sums(temp, a, by_rows)) == MAT_OK)
+            status = mat_copy(out, temp);
+        mat_free(temp);
+        return status;
+    }
+    if (by_rows)
+        status = reduce(row_part, a->rows, a, out, REDUCE_SUM, 0, &total);
+    else
+        status = reduce(column_part, a->cols, a, out, REDUCE_SUM, 0, &total);
+    if (status == MAT_OK)
+        mark_written(out);
+    return status;
+}
+
+/*
+ * mat_row_sums:
+ * saves the sum of each row of "a" in the column vector "out".
+ */
+mat_status mat_row_sums(mat_t *out, const mat_t *a){
+    return sums(out, a, 1);
+}
+
+/*
+ * mat_col_sums:
+ * saves the sum of each column of "a" in the row vector "out".
+ */
+mat_status mat_col_sums(mat_t *out, const mat_t *a){
+    return sums(out, a, 0);
+}
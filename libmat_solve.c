@@ -0,0 +1,504 @@
+#include <stdlib.h>
+#include <math.h>
+#include "libmat.h"
+#include "libmat_private.h"
+
+#define FACTOR_BLOCK 32
+
+/*
+ * the factorizations below are right-looking and blocked: each step
+ * factors a narrow panel with simple loops, then updates the rest of
+ * the matrix with "mat_gemm" on views of it, which is where almost all
+ * of the floating point work goes. every function computes into
+ * temporary matrices and copies the result out only on success, so
+ * failures leave the outputs untouched.
+ */
+
+static int min_int(int a, int b){
+    return a < b ? a : b;
+}
+
+/*
+ * row_axpy:
+ * an auxiliary function
+ * adds alpha times row "src" of "m" to row "dst".
+ */
+static void row_axpy(mat_t *m, int dst, int src, float alpha){
+    int j;
+    for(j = 0; j < m->cols; j++){
+        AT(m, dst, j) += alpha * AT(m, src, j);
+    }
+}
+
+/*
+ * row_scale:
+ * an auxiliary function
+ * multiplies row "i" of "m" by alpha.
+ */
+static void row_scale(mat_t *m, int i, float alpha){
+    int j;
+    for(j = 0; j < m->cols; j++){
+        AT(m, i, j) *= alpha;
+    }
+}
+
+/*
+ * row_swap:
+ * an auxiliary function
+ * swaps rows "i" and "k" of "m".
+ */
+static void row_swap(mat_t *m, int i, int k){
+    int j;
+    float temp;
+    for(j = 0; j < m->cols; j++){
+        temp = AT(m, i, j);
+        AT(m, i, j) = AT(m, k, j);
+        AT(m, k, j) = temp;
+    }
+}
+
+/*
+ * identity:
+ * an auxiliary function
+ * creates an n x n identity matrix.
+ */
+static mat_t *identity(int n){
+    int i;
+    mat_t *m = mat_create(n, n);
+    if (m != NULL){
+        for(i = 0; i < n; i++){
+            AT(m, i, i) = 1.0f;
+        }
+    }
+    return m;
+}
+
+/*
+ * update:
+ * an auxiliary function
+ * c -= a * b, where the three are blocks of "m" given by their corners
+ * and the extent of c and of the shared dimension. this is the
+ * trailing update of the blocked algorithms. if "b_trans" is set, b is
+ * taken transposed from the block at (b_row, b_col).
+ */
+static mat_status update(mat_t *m, int c_row, int c_col, int rows, int cols,
+                        mat_t *a_of, int a_row, int a_col, int inner,
+                        int b_row, int b_col, int b_trans){
+    mat_status status = MAT_ERR_ALLOC;
+    mat_t *c = mat_view(m, c_row, c_col, rows, cols);
+    mat_t *a = mat_view(a_of, a_row, a_col, rows, inner);
+    mat_t *b = b_trans ? mat_slice(a_of, b_row, b_col, cols, inner, 1, 1, 1)
+                        : mat_view(m, b_row, b_col, inner, cols);
+    if (c != NULL && a != NULL && b != NULL)
+        status = mat_gemm(c, a, b, -1.0f, 1.0f);
+    mat_free(c);
+    mat_free(a);
+    mat_free(b);
+    return status;
+}
+
+/*
+ * trsm:
+ * an auxiliary function
+ * solves t * x = b for x in place of b, where t is square and lower
+ * (or upper) triangular, with an implicit unit diagonal if "unit" is
+ * set. blocks of rows are solved directly, then eliminated from the
+ * remaining rows with "mat_gemm".
+ */
+static mat_status trsm(mat_t *t, mat_t *b, int lower, int unit){
+    int i, k, k0, kb, n = t->rows;
+    mat_status status;
+    for(k0 = lower ? 0 : ((n - 1) / FACTOR_BLOCK) * FACTOR_BLOCK; 0 <= k0 && k0 < n;
+            k0 += lower ? FACTOR_BLOCK : -FACTOR_BLOCK){
+        kb = min_int(FACTOR_BLOCK, n - k0);
+        for(i = lower ? k0 : k0 + kb - 1; k0 <= i && i < k0 + kb; i += lower ? 1 : -1){
+            for(k = lower ? k0 : i + 1; k < (lower ? i : k0 + kb); k++){
+                row_axpy(b, i, k, -AT(t, i, k));
+            }
+            if (!unit){
+                if (AT(t, i, i) == 0.0f)
+                    return MAT_ERR_SINGULAR;
+                row_scale(b, i, 1.0f / AT(t, i, i));
+            }
+        }
+        if (lower && k0 + kb < n)
+            status = update(b, k0 + kb, 0, n - k0 - kb, b->cols, t, k0 + kb, k0, kb, k0, 0, 0);
+        else if (!lower && k0 > 0)
+            status = update(b, 0, 0, k0, b->cols, t, 0, k0, kb, k0, 0, 0);
+        else
+            status = MAT_OK;
+        if (status != MAT_OK)
+            return status;
+    }
+    return MAT_OK;
+}
+
+/*
+ * lu_factor:
+ * an auxiliary function
+ * factors the square matrix "a" in place into P * a = L * U with partial
+ * pivoting: U on and above the diagonal, L (unit diagonal) below it.
+ * row i was swapped with row piv[i], "swaps" counts the actual swaps.
+ * a singular matrix is still factored, but MAT_ERR_SINGULAR is returned.
+ */
+static mat_status lu_factor(mat_t *a, int *piv, int *swaps){
+    int i, j, c, p, j0, jb, n = a->rows;
+    float l;
+    mat_t *l11, *a12;
+    mat_status status = MAT_OK, singular = MAT_OK;
+    *swaps = 0;
+    for(j0 = 0; j0 < n && status == MAT_OK; j0 += FACTOR_BLOCK){
+        jb = min_int(FACTOR_BLOCK, n - j0);
+        for(j = j0; j < j0 + jb; j++){
+            for(p = j, i = j + 1; i < n; i++){
+                if (fabs(AT(a, i, j)) > fabs(AT(a, p, j)))
+                    p = i;
+            }
+            piv[j] = p;
+            if (p != j){
+                row_swap(a, j, p);
+                (*swaps)++;
+            }
+            if (AT(a, j, j) == 0.0f){
+                singular = MAT_ERR_SINGULAR;
+                continue;
+            }
+            for(i = j + 1; i < n; i++){
+                l = AT(a, i, j) /= AT(a, j, j);
+                for(c = j + 1; c < j0 + jb; c++){
+                    AT(a, i, c) -= l * AT(a, j, c);
+                }
+            }
+        }
+        if (j0 + jb < n){
+            l11 = mat_view(a, j0, j0, jb, jb);
+            a12 = mat_view(a, j0, j0 + jb, jb, n - j0 - jb);
+            status = l11 != NULL && a12 != NULL ? trsm(l11, a12, 1, 1) : MAT_ERR_ALLOC;
+            mat_free(l11);
+            mat_free(a12);
+            if (status == MAT_OK)
+                status = update(a, j0 + jb, j0 + jb, n - j0 - jb, n - j0 - jb, a, j0 + jb, j0, jb, j0, j0 + jb, 0);
+        }
+    }
+    return status == MAT_OK ? singular : status;
+}
+
+/*
+ * factor_copy:
+ * an auxiliary function
+ * copies the square matrix "a" and its LU factorization, see "lu_factor".
+ */
+static mat_status factor_copy(const mat_t *a, mat_t **lu, int **piv, int *swaps){
+    mat_status status;
+    if (a->rows != a->cols)
+        return MAT_ERR_SHAPE;
+    *lu = mat_dup(a);
+    *piv = malloc(a->rows * sizeof(int));
+    if (*lu == NULL || *piv == NULL)
+        status = MAT_ERR_ALLOC;
+    else
+        status = lu_factor(*lu, *piv, swaps);
+    if (status != MAT_OK){
+        mat_free(*lu);
+        free(*piv);
+    }
+    return status;
+}
+
+/*
+ * mat_lu:
+ * factors the square matrix "a" into P * a = L * U, and saves L and U
+ * packed into "lu": U on and above the diagonal, L (unit diagonal)
+ * below it. if "piv" isn't NULL it receives the row interchanges, row
+ * i was swapped with row piv[i]. returns MAT_ERR_SINGULAR, and doesn't
+ * write the outputs, if the matrix is singular.
+ */
+mat_status mat_lu(mat_t *lu, int *piv, const mat_t *a){
+    int i, swaps, *temp_piv;
+    mat_t *temp;
+    mat_status status;
+    if (lu->rows != a->rows || lu->cols != a->cols)
+        return MAT_ERR_SHAPE;
+    if ((status = factor_copy(a, &temp, &temp_piv, &swaps)) != MAT_OK)
+        return status;
+    mat_copy(lu, temp);
+    for(i = 0; piv != NULL && i < a->rows; i++){
+        piv[i] = temp_piv[i];
+    }
+    mat_free(temp);
+    free(temp_piv);
+    return MAT_OK;
+}
+
+/*
+ * mat_chol:
+ * the Cholesky factorization of the symmetric positive definite matrix
+ * "a", of which only the lower triangle is read (and updated, the
+ * upper one is stale until it's cleared at the end): l * l^T = a, where
+ * l is lower triangular (its upper triangle is set to zeros). returns
+ * MAT_ERR_NOT_SPD if "a" is not positive definite.
+ */
+mat_status mat_chol(mat_t *l, const mat_t *a){
+    int i, j, k, j0, jb, c0, n = a->rows;
+    double sum;
+    mat_t *temp, *l11, *a21t;
+    mat_status status = MAT_OK;
+    if (a->rows != a->cols || l->rows != n || l->cols != n)
+        return MAT_ERR_SHAPE;
+    if ((temp = mat_dup(a)) == NULL)
+        return MAT_ERR_ALLOC;
+    for(j0 = 0; j0 < n && status == MAT_OK; j0 += FACTOR_BLOCK){
+        jb = min_int(FACTOR_BLOCK, n - j0);
+        for(j = j0; j < j0 + jb && status == MAT_OK; j++){
+            for(sum = AT(temp, j, j), k = j0; k < j; k++){
+                sum -= (double)AT(temp, j, k) * AT(temp, j, k);
+            }
+            if (sum <= 0.0){
+                status = MAT_ERR_NOT_SPD;
+                break;
+            }
+            AT(temp, j, j) = (float)sqrt(sum);
+            for(i = j + 1; i < j0 + jb; i++){
+                for(sum = AT(temp, i, j), k = j0; k < j; k++){
+                    sum -= (double)AT(temp, i, k) * AT(temp, j, k);
+                }
+                AT(temp, i, j) = (float)(sum / AT(temp, j, j));
+            }
+        }
+        if (status == MAT_OK && j0 + jb < n){
+            /* L21 * L11^T = A21 is solved as L11 * L21^T = A21^T, on a transposed view */
+            l11 = mat_view(temp, j0, j0, jb, jb);
+            a21t = mat_slice(temp, j0 + jb, j0, n - j0 - jb, jb, 1, 1, 1);
+            status = l11 != NULL && a21t != NULL ? trsm(l11, a21t, 1, 0) : MAT_ERR_ALLOC;
+            mat_free(l11);
+            mat_free(a21t);
+            /* A22 -= L21 * L21^T on and below the diagonal only, a block column at a time */
+            for(c0 = j0 + jb; c0 < n && status == MAT_OK; c0 += FACTOR_BLOCK){
+                status = update(temp, c0, c0, n - c0, min_int(FACTOR_BLOCK, n - c0), temp, c0, j0, jb, c0, j0, 1);
+            }
+        }
+    }
+    if (status == MAT_OK){
+        for(i = 0; i < n; i++){
+            for(j = i + 1; j < n; j++){
+                AT(temp, i, j) = 0.0f;
+            }
+        }
+        mat_copy(l, temp);
+    }
+    mat_free(temp);
+    return status;
+}
+
+/*
+ * qr_panel:
+ * an auxiliary function
+ * factors the kb columns of "r" from k0 on with Householder reflections
+ * H = I - tau v v^T, one column at a time, applying each to the rest of
+ * the panel only. the vectors v are saved in the columns of "v" (zeros
+ * above their first row), and "t" receives the upper triangular matrix
+ * of their compact WY form: H1 * H2 * ... * Hkb = I - V T V^T.
+ */
+static void qr_panel(mat_t *r, mat_t *v, mat_t *t, int k0, int kb){
+    int i, j, c, k, m = r->rows;
+    double norm, dot, alpha, tau[FACTOR_BLOCK], w[FACTOR_BLOCK];
+    for(j = 0; j < kb; j++){
+        k = k0 + j;
+        for(norm = 0.0, i = 0; i < m; i++){
+            AT(v, i, j) = 0.0f;
+            if (i >= k)
+                norm += (double)AT(r, i, k) * AT(r, i, k);
+        }
+        tau[j] = 0.0;
+        if (norm == 0.0)
+            continue;
+        alpha = AT(r, k, k) > 0.0f ? -sqrt(norm) : sqrt(norm);
+        AT(v, k, j) = (float)(AT(r, k, k) - alpha);
+        for(norm = (double)AT(v, k, j) * AT(v, k, j), i = k + 1; i < m; i++){
+            AT(v, i, j) = AT(r, i, k);
+            norm += (double)AT(v, i, j) * AT(v, i, j);
+        }
+        tau[j] = 2.0 / norm;
+        for(c = k + 1; c < k0 + kb; c++){
+            for(dot = 0.0, i = k; i < m; i++){
+                dot += (double)AT(v, i, j) * AT(r, i, c);
+            }
+            for(dot *= tau[j], i = k; i < m; i++){
+                AT(r, i, c) -= (float)(dot * AT(v, i, j));
+            }
+        }
+        AT(r, k, k) = (float)alpha;
+        for(i = k + 1; i < m; i++){
+            AT(r, i, k) = 0.0f;
+        }
+    }
+    /* column j of T is -tau_j * T * V^T v_j above the diagonal, tau_j on it */
+    for(j = 0; j < kb; j++){
+        for(i = 0; i < j; i++){
+            for(w[i] = 0.0, c = k0 + j; c < m; c++){
+                w[i] += (double)AT(v, c, i) * AT(v, c, j);
+            }
+        }
+        for(i = 0; i < kb; i++){
+            for(dot = 0.0, c = i; c < j; c++){
+                dot += AT(t, i, c) * w[c];
+            }
+            AT(t, i, j) = (float)(i < j ? -tau[j] * dot : i == j ? tau[j] : 0.0);
+        }
+    }
+}
+
+/*
+ * qr_update:
+ * an auxiliary function
+ * applies the block reflection I - V T V^T of the panel at k0 (see
+ * "qr_panel") to the columns of "r" right of the panel, R = (I - V T^T
+ * V^T) R, and accumulates it into "q", Q = Q (I - V T V^T), each with
+ * three "mat_gemm" calls. only the rows of R and the columns of Q from
+ * k0 on are touched, since V is zero above them. "w" (2 FACTOR_BLOCK x
+ * n) and "x" (m x 2 FACTOR_BLOCK) hold the intermediate products.
+ */
+static mat_status qr_update(mat_t *q, mat_t *r, mat_t *v, mat_t *t, mat_t *w, mat_t *x, int k0, int kb){
+    int m = r->rows, nt = r->cols - k0 - kb;
+    mat_t *vk, *vkt, *tk, *tkt, *rk, *w1, *w2, *qk, *x1, *x2;
+    mat_status status = MAT_ERR_ALLOC;
+    vk = mat_view(v, k0, 0, m - k0, kb);
+    vkt = mat_slice(v, k0, 0, m - k0, kb, 1, 1, 1);
+    tk = mat_view(t, 0, 0, kb, kb);
+    tkt = mat_slice(t, 0, 0, kb, kb, 1, 1, 1);
+    rk = nt > 0 ? mat_view(r, k0, k0 + kb, m - k0, nt) : NULL;
+    w1 = nt > 0 ? mat_view(w, 0, 0, kb, nt) : NULL;
+    w2 = nt > 0 ? mat_view(w, FACTOR_BLOCK, 0, kb, nt) : NULL;
+    qk = mat_view(q, 0, k0, m, m - k0);
+    x1 = mat_view(x, 0, 0, m, kb);
+    x2 = mat_view(x, 0, FACTOR_BLOCK, m, kb);
+    if (vk != NULL && vkt != NULL && tk != NULL && tkt != NULL && qk != NULL && x1 != NULL && x2 != NULL &&
+            (nt == 0 || (rk != NULL && w1 != NULL && w2 != NULL)) &&
+            (nt == 0 || ((status = mat_gemm(w1, vkt, rk, 1.0f, 0.0f)) == MAT_OK &&
+                         (status = mat_gemm(w2, tkt, w1, 1.0f, 0.0f)) == MAT_OK &&
+                         (status = mat_gemm(rk, vk, w2, -1.0f, 1.0f)) == MAT_OK)) &&
+            (status = mat_gemm(x1, qk, vk, 1.0f, 0.0f)) == MAT_OK &&
+            (status = mat_gemm(x2, x1, tk, 1.0f, 0.0f)) == MAT_OK)
+        status = mat_gemm(qk, x2, vkt, -1.0f, 1.0f);
+    mat_free(vk);
+    mat_free(vkt);
+    mat_free(tk);
+    mat_free(tkt);
+    mat_free(rk);
+    mat_free(w1);
+    mat_free(w2);
+    mat_free(qk);
+    mat_free(x1);
+    mat_free(x2);
+    return status;
+}
+
+/*
+ * mat_qr:
+ * the QR factorization of the m x n matrix "a" using Householder
+ * reflections: q (m x m) is orthogonal and r (m x n) upper triangular,
+ * q * r = a. the reflections of a panel of FACTOR_BLOCK columns are
+ * gathered into one block reflection, which updates the rest of r and
+ * q with "mat_gemm".
+ */
+mat_status mat_qr(mat_t *q, mat_t *r, const mat_t *a){
+    int k0, kb, m = a->rows, n = a->cols, steps = min_int(a->rows - 1, a->cols);
+    mat_t *temp_q, *temp_r, *v, *t, *w, *x;
+    mat_status status = MAT_ERR_ALLOC;
+    if (q->rows != m || q->cols != m || r->rows != m || r->cols != n)
+        return MAT_ERR_SHAPE;
+    temp_q = identity(m);
+    temp_r = mat_dup(a);
+    v = mat_create(m, FACTOR_BLOCK);
+    t = mat_create(FACTOR_BLOCK, FACTOR_BLOCK);
+    w = mat_create(2 * FACTOR_BLOCK, n);
+    x = mat_create(m, 2 * FACTOR_BLOCK);
+    if (temp_q != NULL && temp_r != NULL && v != NULL && t != NULL && w != NULL && x != NULL){
+        for(status = MAT_OK, k0 = 0; k0 < steps && status == MAT_OK; k0 += FACTOR_BLOCK){
+            kb = min_int(FACTOR_BLOCK, steps - k0);
+            qr_panel(temp_r, v, t, k0, kb);
+            status = qr_update(temp_q, temp_r, v, t, w, x, k0, kb);
+        }
+    }
+    if (status == MAT_OK){
+        mat_copy(q, temp_q);
+        mat_copy(r, temp_r);
+    }
+    mat_free(temp_q);
+    mat_free(temp_r);
+    mat_free(v);
+    mat_free(t);
+    mat_free(w);
+    mat_free(x);
+    return status;
+}
+
+/*
+ * mat_solve:
+ * solves a * x = b, where "a" is square, using its LU factorization,
+ * "b" may hold several right hand sides (columns), "x" has its shape.
+ */
+mat_status mat_solve(mat_t *x, const mat_t *a, const mat_t *b){
+    int i, swaps, *piv;
+    mat_t *lu, *temp;
+    mat_status status;
+    if (b->rows != a->rows || x->rows != b->rows || x->cols != b->cols)
+        return MAT_ERR_SHAPE;
+    if ((status = factor_copy(a, &lu, &piv, &swaps)) != MAT_OK)
+        return status;
+    if ((temp = mat_dup(b)) == NULL)
+        status = MAT_ERR_ALLOC;
+    else {
+        for(i = 0; i < temp->rows; i++){
+            if (piv[i] != i)
+                row_swap(temp, i, piv[i]);
+        }
+        if ((status = trsm(lu, temp, 1, 1)) == MAT_OK && (status = trsm(lu, temp, 0, 0)) == MAT_OK)
+            mat_copy(x, temp);
+    }
+    mat_free(temp);
+    mat_free(lu);
+    free(piv);
+    return status;
+}
+
+/*
+ * mat_inv:
+ * x = the inverse of the square matrix "a", found by solving a * x = I.
+ */
+mat_status mat_inv(mat_t *x, const mat_t *a){
+    mat_status status;
+    mat_t *id;
+    if (a->rows != a->cols)
+        return MAT_ERR_SHAPE;
+    if ((id = identity(a->rows)) == NULL)
+        return MAT_ERR_ALLOC;
+    status = mat_solve(x, a, id);
+    mat_free(id);
+    return status;
+}
+
+/*
+ * mat_det:
+ * saves the determinant of the square matrix "a" in "det": the product
+ * of the diagonal of U, negated for an odd number of row swaps.
+ */
+mat_status mat_det(const mat_t *a, float *det){
+    int i, swaps, *piv;
+    double product = 1.0;
+    mat_t *lu;
+    mat_status status = factor_copy(a, &lu, &piv, &swaps);
+    if (status == MAT_ERR_SINGULAR){
+        *det = 0.0f;
+        return MAT_OK;
+    }
+    if (status != MAT_OK)
+        return status;
+    for(i = 0; i < lu->rows; i++){
+        product *= AT(lu, i, i);
+    }
+    *det = (float)(swaps % 2 ? -product : product);
+    mat_free(lu);
+    free(piv);
+    return MAT_OK;
+}
@@ -1,160 +1,523 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "mat.h"
-
-/*
- * create_matrix:
- * creates a square matrix of size N, returns a pointer
- * to pointer of float. "calloc" is used, to make sure all
- * elements are initialized to zeros.
- */
-matrix create_matrix(int N){
-    int i;
-    matrix array;
-    array = (float**)malloc(N * sizeof(float*));
-    for(i = 0; i < N; i++){
-        array[i] = (float*)calloc(N, sizeof(float));
-    }
-    return array;
-}
-
-/*
- * free_matrix:
- * takes a pointer to a pointer of floats, frees the allocated
- * memory of each pointer to float, then frees the memory allocated
- * to the pointer to pointer of float.
- */
-void free_matrix(matrix xx, int N){
-    int i;
-    for(i =0; i < N; i++){
-        free(*(xx + i));
-    }
-    free(xx);
-}
+#include "report.h"
 
 /*
  * matrix_data:
  * takes a parameters structure as input and an index of the
  * selected matrix (of type "mat"), and returns its data member,
- * which is a pointer to pointer of float (typedef matrix).
+ * which is a handle to the matrix engine (mat_t).
  */
-static float **matrix_data(parameters *params, int index){
+static mat_t *matrix_data(parameters *params, int index){
     return (params->matrices)[(params->mat_selection)[index]].data;
 }
 
 /*
  * print_matrix:
- * takes a parameters structure and size, and prints the members
- * of the mat selected by the user (the input mat).
+ * takes a parameters structure, and prints the members of the mat
+ * selected by the user (the input mat), whatever its shape.
  */
-void print_matrix(parameters *params, int N){
+void print_matrix(parameters *params){
     int i, j;
-    for(i = 0; i < N; i++){
-        for(j = 0; j < N; j++){
-            printf("%-9.2f\t", ((params->matrices)[(params->mat_selection)[0]].data)[i][j]);
+    mat_t *m = matrix_data(params, 0);
+    for(i = 0; i < mat_rows(m); i++){
+        for(j = 0; j < mat_cols(m); j++){
+            fprintf(params->out, "%-9.2f\t", mat_get(m, i, j));
         }
-        puts("");
+        fputc('\n', params->out);
     }
 }
 
 /*
- * mult_row_column:
+ * output_matrix:
  * an auxiliary function
- * takes 2d arrays, a row index, a column index and size, returns
- * the sum product, this is the i,j element in the product of the
- * matrices.
- */
-static float mult_row_column(matrix xx, matrix yy, int i, int j, int size){
-    int k;
-    float result = 0;    
-    for(k = 0; k < size; k++){
-        result += xx[i][k] * yy[k][j];
+ * returns the matrix a rows x cols result should be written to: the
+ * output matrix selected by the user (mat_selection[index], 2 or 3 for
+ * the second output) if it already has that shape, so
+ * the result lands in place and views of it stay in sync, otherwise a
+ * new matrix, which "store_result" puts in its place. a view can't
+ * change its shape, so in that case status is set to MAT_ERR_SHAPE.
+ */
+static mat_t *output_matrix(parameters *params, int index, int rows, int cols, mat_status *status){
+    mat_t *output = matrix_data(params, index), *result = output;
+    *status = MAT_OK;
+    if (mat_rows(output) != rows || mat_cols(output) != cols){
+        if (mat_is_view(output))
+            *status = MAT_ERR_SHAPE;
+        else if ((result = mat_create(rows, cols)) == NULL)
+            *status = MAT_ERR_ALLOC;
     }
     return result;
 }
 
 /*
- * mul_matrix:
- * takes a "parameters" structure and size, creates a new matrix
- * to save the result, accesses the matrix parts of the user selected
- * matrices, multiplies the matrices, saves the result in temp,
- * then frees whatever matrix is in the output matrix, selected by the
- * user, then replaces it with the temp matrix.
+ * store_result:
+ * an auxiliary function
+ * takes the status of the operation which computed "result" (returned
+ * by "output_matrix" for the same index): on failure the error is
+ * reported and the output matrix is left untouched, otherwise, if the
+ * result was computed in a new matrix, the output matrix selected by
+ * the user is freed and replaced with it.
  */
-void mul_matrix(parameters *params, int size){
-    int i, j;
-    matrix temp_matrix = create_matrix(size);
-    for(i = 0; i < size; i++){
-        for(j = 0; j < size; j++){
-            temp_matrix[i][j] = mult_row_column(matrix_data(params, 0), matrix_data(params, 1), i, j, size);
-        }
+static void store_result(parameters *params, int index, mat_t *result, mat_status status){
+    mat_t *output = matrix_data(params, index);
+    if (status != MAT_OK){
+        report_failure(params, mat_strerror(status));
+        if (result != output)
+            mat_free(result);
+    }
+    else if (result != output){
+        mat_free(output);
+        (params->matrices)[(params->mat_selection)[index]].data = result;
     }
-    free_matrix(matrix_data(params, 2), size);
-    (params->matrices)[(params->mat_selection)[2]].data = temp_matrix;
+}
+
+/*
+ * mul_matrix:
+ * takes a "parameters" structure, finds where the product of the user
+ * selected matrices should be saved, multiplies them into it using the
+ * engine, then stores the result in the output matrix selected by the
+ * user.
+ */
+void mul_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), mat_cols(matrix_data(params, 1)), &status);
+    if (status == MAT_OK)
+        status = mat_gemm(result, matrix_data(params, 0), matrix_data(params, 1), 1.0f, 0.0f);
+    store_result(params, 2, result, status);
 }
 
 /*
  * add_matrix:
  * works like "mul_matrix", performs simple matrix addition.
  */
-void add_matrix(parameters *params, int size){
-    int i, j;
-    matrix temp_matrix = create_matrix(size);
-    for(i = 0; i < size; i++){
-        for(j = 0; j < size; j++){
-            temp_matrix[i][j] = (matrix_data(params, 0))[i][j] + (matrix_data(params, 1))[i][j];
-        }
-    }
-    free_matrix(matrix_data(params, 2), size);
-    (params->matrices)[(params->mat_selection)[2]].data = temp_matrix;
+void add_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), mat_cols(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_add(result, matrix_data(params, 0), matrix_data(params, 1));
+    store_result(params, 2, result, status);
 }
 
 /*
  * sub_matrix:
  * works like "mul_matrix", performs simple matrix subtraction.
  */
-void sub_matrix(parameters *params, int size){
-    int i, j;
-    matrix temp_matrix = create_matrix(size);
-    for(i = 0; i < size; i++){
-        for(j = 0; j < size; j++){
-            temp_matrix[i][j] = (matrix_data(params, 0))[i][j] - (matrix_data(params, 1))[i][j];
-        }
-    }
-    free_matrix(matrix_data(params, 2), size);
-    (params->matrices)[(params->mat_selection)[2]].data = temp_matrix;
+void sub_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), mat_cols(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_sub(result, matrix_data(params, 0), matrix_data(params, 1));
+    store_result(params, 2, result, status);
 }
 
 /*
- * sub_matrix:
+ * mul_scalar:
  * works like "mul_matrix", performs matrix multiplication,
  * the scalar is supplied by the user.
  */
-void mul_scalar(parameters *params, int size){
-    int i, j;
-    matrix temp_matrix = create_matrix(size);
-    for(i = 0; i < size; i++){
-        for(j = 0; j < size; j++){
-            temp_matrix[i][j] = params->scalar_input * (matrix_data(params, 0))[i][j];
-        }
-    }
-    free_matrix(matrix_data(params, 2), size);
-    (params->matrices)[(params->mat_selection)[2]].data = temp_matrix;
+void mul_scalar(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), mat_cols(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_scale(result, matrix_data(params, 0), params->scalar_input);
+    store_result(params, 2, result, status);
 }
 
 /*
- * sub_matrix:
+ * trans_matrix:
  * works like "mul_matrix", transposes selected input matrix
  * and saves the result in the selected output matrix.
  */
-void trans_matrix(parameters *params, int size){
-    int i, j;
-    matrix temp_matrix = create_matrix(size);
-    for(i = 0; i < size; i++){
-        for(j = 0; j < size; j++){
-            temp_matrix[i][j] = (matrix_data(params, 0))[j][i];
+void trans_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_cols(matrix_data(params, 0)), mat_rows(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_trans(result, matrix_data(params, 0));
+    store_result(params, 2, result, status);
+}
+
+/*
+ * square_input:
+ * an auxiliary function
+ * returns 1 if the input matrix selected by the user is square,
+ * otherwise reports an error and returns 0.
+ */
+static int square_input(parameters *params){
+    if (mat_rows(matrix_data(params, 0)) == mat_cols(matrix_data(params, 0)))
+        return 1;
+    report_failure(params, "matrix should be square");
+    return 0;
+}
+
+/*
+ * lu_matrix:
+ * saves the LU factorization (with partial pivoting) of the selected
+ * input matrix A in the two selected output matrices, P * A = L * U:
+ * L and U packed in the first, U on and above the diagonal, L (which
+ * has a unit diagonal) below it, and the permutation matrix P of the
+ * row interchanges in the second. like "qr_matrix", either both of
+ * them are written or none.
+ */
+void lu_matrix(parameters *params){
+    mat_status status, p_status;
+    mat_t *result, *p, *input = matrix_data(params, 0);
+    int *piv, *perm, i, j, n = mat_rows(input);
+    float *elements;
+    if (!square_input(params))
+        return;
+    if ((params->mat_selection)[2] == (params->mat_selection)[3]){
+        report_failure(params, "output matrices should be different");
+        return;
+    }
+    result = output_matrix(params, 2, n, n, &status);
+    p = output_matrix(params, 3, n, n, &p_status);
+    if (status == MAT_OK)
+        status = p_status;
+    piv = malloc(2 * n * sizeof(int));
+    elements = calloc((size_t)n * n, sizeof(float));
+    if (status == MAT_OK && (piv == NULL || elements == NULL))
+        status = MAT_ERR_ALLOC;
+    if (status == MAT_OK && (status = mat_lu(result, piv, input)) == MAT_OK){
+        perm = piv + n;
+        for(i = 0; i < n; i++)
+            perm[i] = i;
+        for(i = 0; i < n; i++){
+            j = perm[i];
+            perm[i] = perm[piv[i]];
+            perm[piv[i]] = j;
         }
+        for(i = 0; i < n; i++)
+            elements[i * n + perm[i]] = 1.0f;
+        mat_load(p, elements);
+    }
+    free(piv);
+    free(elements);
+    store_result(params, 2, result, status);
+    if (status == MAT_OK)
+        store_result(params, 3, p, status);
+    else if (p != matrix_data(params, 3))
+        mat_free(p);
+}
+
+/*
+ * chol_matrix:
+ * works like "mul_matrix", saves the lower triangular Cholesky factor
+ * of the selected (symmetric positive definite) input matrix.
+ */
+void chol_matrix(parameters *params){
+    mat_status status;
+    mat_t *result, *input = matrix_data(params, 0);
+    if (!square_input(params))
+        return;
+    result = output_matrix(params, 2, mat_rows(input), mat_cols(input), &status);
+    if (status == MAT_OK)
+        status = mat_chol(result, input);
+    store_result(params, 2, result, status);
+}
+
+/*
+ * qr_matrix:
+ * saves the QR factorization of the selected input matrix in the two
+ * selected output matrices, Q in the first and R in the second. both
+ * outputs are prepared before the factorization, so either both of
+ * them are written or none.
+ */
+void qr_matrix(parameters *params){
+    mat_status status, r_status;
+    mat_t *q, *r, *input = matrix_data(params, 0);
+    if ((params->mat_selection)[2] == (params->mat_selection)[3]){
+        report_failure(params, "output matrices should be different");
+        return;
+    }
+    q = output_matrix(params, 2, mat_rows(input), mat_rows(input), &status);
+    r = output_matrix(params, 3, mat_rows(input), mat_cols(input), &r_status);
+    if (status == MAT_OK)
+        status = r_status;
+    if (status == MAT_OK)
+        status = mat_qr(q, r, input);
+    store_result(params, 2, q, status);
+    if (status == MAT_OK)
+        store_result(params, 3, r, status);
+    else if (r != matrix_data(params, 3))
+        mat_free(r);
+}
+
+/*
+ * solve_matrix:
+ * works like "mul_matrix", solves A * X = B where A and B are the
+ * selected input matrices, and saves X in the selected output matrix.
+ */
+void solve_matrix(parameters *params){
+    mat_status status;
+    mat_t *result, *b = matrix_data(params, 1);
+    if (!square_input(params))
+        return;
+    result = output_matrix(params, 2, mat_rows(b), mat_cols(b), &status);
+    if (status == MAT_OK)
+        status = mat_solve(result, matrix_data(params, 0), b);
+    store_result(params, 2, result, status);
+}
+
+/*
+ * inv_matrix:
+ * works like "mul_matrix", inverts the selected input matrix.
+ */
+void inv_matrix(parameters *params){
+    mat_status status;
+    mat_t *result, *input = matrix_data(params, 0);
+    if (!square_input(params))
+        return;
+    result = output_matrix(params, 2, mat_rows(input), mat_cols(input), &status);
+    if (status == MAT_OK)
+        status = mat_inv(result, input);
+    store_result(params, 2, result, status);
+}
+
+/*
+ * det_matrix:
+ * prints the determinant of the selected input matrix.
+ */
+void det_matrix(parameters *params){
+    float det;
+    mat_status status;
+    if (!square_input(params))
+        return;
+    if ((status = mat_det(matrix_data(params, 0), &det)) != MAT_OK)
+        report_failure(params, mat_strerror(status));
+    else
+        fprintf(params->out, "%.2f\n", det);
+}
+
+/*
+ * print_value:
+ * an auxiliary function
+ * takes the status of the operation which computed "value": prints
+ * the error, or the value, like "det_matrix" does.
+ */
+static void print_value(parameters *params, mat_status status, const float *value){
+    if (status != MAT_OK)
+        report_failure(params, mat_strerror(status));
+    else
+        fprintf(params->out, "%.2f\n", *value);
+}
+
+/*
+ * sum_matrix:
+ * prints the sum of the elements of the selected input matrix.
+ */
+void sum_matrix(parameters *params){
+    float sum;
+    print_value(params, mat_sum(matrix_data(params, 0), &sum), &sum);
+}
+
+/*
+ * norm_matrix, norm1_matrix, norminf_matrix:
+ * print the Frobenius, 1 and infinity norms of the selected input
+ * matrix (see "mat_norm").
+ */
+void norm_matrix(parameters *params){
+    float norm;
+    print_value(params, mat_norm(matrix_data(params, 0), MAT_NORM_FRO, &norm), &norm);
+}
+
+void norm1_matrix(parameters *params){
+    float norm;
+    print_value(params, mat_norm(matrix_data(params, 0), MAT_NORM_ONE, &norm), &norm);
+}
+
+void norminf_matrix(parameters *params){
+    float norm;
+    print_value(params, mat_norm(matrix_data(params, 0), MAT_NORM_INF, &norm), &norm);
+}
+
+/*
+ * trace_matrix:
+ * prints the trace of the selected input matrix, which should be
+ * square.
+ */
+void trace_matrix(parameters *params){
+    float trace;
+    if (square_input(params))
+        print_value(params, mat_trace(matrix_data(params, 0), &trace), &trace);
+}
+
+/*
+ * minmax_matrix:
+ * prints the smallest and the largest element of the selected input
+ * matrix.
+ */
+void minmax_matrix(parameters *params){
+    float min, max;
+    mat_status status = mat_minmax(matrix_data(params, 0), &min, &max);
+    if (status != MAT_OK)
+        report_failure(params, mat_strerror(status));
+    else
+        fprintf(params->out, "%.2f %.2f\n", min, max);
+}
+
+/*
+ * sum_rows_matrix:
+ * works like "mul_matrix", saves the sum of each row of the selected
+ * input matrix in the selected output matrix, a column vector.
+ */
+void sum_rows_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), 1, &status);
+    if (status == MAT_OK)
+        status = mat_row_sums(result, matrix_data(params, 0));
+    store_result(params, 2, result, status);
+}
+
+/*
+ * sum_cols_matrix:
+ * works like "mul_matrix", saves the sum of each column of the selected
+ * input matrix in the selected output matrix, a row vector.
+ */
+void sum_cols_matrix(parameters *params){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, 1, mat_cols(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_col_sums(result, matrix_data(params, 0));
+    store_result(params, 2, result, status);
+}
+
+/*
+ * map_steps:
+ * an auxiliary function
+ * works like "mul_matrix", applies the "count" element-wise "steps" to
+ * the selected input matrix in a single pass (see "mat_map") and saves
+ * the result, of the same shape, in the selected output matrix.
+ */
+static void map_steps(parameters *params, const mat_map_step *steps, int count){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(matrix_data(params, 0)), mat_cols(matrix_data(params, 0)), &status);
+    if (status == MAT_OK)
+        status = mat_map(result, matrix_data(params, 0), steps, count);
+    store_result(params, 2, result, status);
+}
+
+/*
+ * elem_matrix:
+ * an auxiliary function
+ * applies the arithmetic operation "op" to the selected input matrices,
+ * element by element, the second may also be a row, a column or a
+ * single element, repeated over the first.
+ */
+static void elem_matrix(parameters *params, mat_map_op op){
+    mat_map_step step;
+    step.op = op;
+    step.operand = matrix_data(params, 1);
+    step.scalar = step.limit = 0.0f;
+    map_steps(params, &step, 1);
+}
+
+/*
+ * mul_elem_matrix, div_elem_matrix:
+ * work like "mul_matrix", multiply and divide the selected input
+ * matrices element by element (see "elem_matrix").
+ */
+void mul_elem_matrix(parameters *params){
+    elem_matrix(params, MAT_MAP_MUL);
+}
+
+void div_elem_matrix(parameters *params){
+    elem_matrix(params, MAT_MAP_DIV);
+}
+
+/*
+ * exp_matrix, relu_matrix:
+ * work like "mul_matrix", save e raised to each element of the
+ * selected input matrix, or the positive part of each element, in the
+ * selected output matrix.
+ */
+void exp_matrix(parameters *params){
+    mat_map_step step;
+    step.op = MAT_MAP_EXP;
+    step.operand = NULL;
+    step.scalar = step.limit = 0.0f;
+    map_steps(params, &step, 1);
+}
+
+void relu_matrix(parameters *params){
+    mat_map_step step;
+    step.op = MAT_MAP_RELU;
+    step.operand = NULL;
+    step.scalar = step.limit = 0.0f;
+    map_steps(params, &step, 1);
+}
+
+/*
+ * map_matrix:
+ * runs the operations of the "map" command, resolving the matrices
+ * they take, over the selected input matrix, in a single pass.
+ */
+void map_matrix(parameters *params){
+    mat_map_step steps[MAX_MAP_STAGES];
+    map_stage *stage;
+    int i;
+    for(i = 0; i < params->stages_count; i++){
+        stage = &(params->stages)[i];
+        steps[i].op = stage->op;
+        steps[i].operand = stage->operand >= 0 ? (params->matrices)[stage->operand].data : NULL;
+        steps[i].scalar = stage->scalar;
+        steps[i].limit = stage->limit;
+    }
+    map_steps(params, steps, params->stages_count);
+}
+
+/*
+ * copy_matrix:
+ * works like "mul_matrix", saves a copy of "source" in the selected
+ * output matrix.
+ */
+void copy_matrix(parameters *params, const mat_t *source){
+    mat_status status;
+    mat_t *result = output_matrix(params, 2, mat_rows(source), mat_cols(source), &status);
+    if (status == MAT_OK)
+        status = mat_copy(result, source);
+    store_result(params, 2, result, status);
+}
+
+/*
+ * view_matrix:
+ * makes the output matrix selected by the user a view of the block of
+ * the input matrix described by the "view" parameter, no data is
+ * copied: operations that write to the output write to the input.
+ * the view keeps referring to the same storage even if the input is
+ * later replaced by a result of a different shape. the block was
+ * resolved when the command was read, so it's checked again, since
+ * another session of the server may have reshaped the input since.
+ */
+void view_matrix(parameters *params){
+    slice *v = params->view;
+    mat_t *input = matrix_data(params, 0), *view;
+    if (v->row + (v->rows - 1) * v->row_step >= mat_rows(input)
+        || v->col + (v->cols - 1) * v->col_step >= mat_cols(input)){
+        report_failure(params, mat_strerror(MAT_ERR_RANGE));
+        return;
+    }
+    view = mat_slice(input, v->row, v->col, v->rows, v->cols, v->row_step, v->col_step, v->transpose);
+    if (view == NULL){
+        report_failure(params, mat_strerror(MAT_ERR_ALLOC));
+        return;
+    }
+    mat_free(matrix_data(params, 2));
+    (params->matrices)[(params->mat_selection)[2]].data = view;
+}
+
+/*
+ * unview_matrix:
+ * replaces the output matrix selected by the user with a copy it owns,
+ * so a view stops sharing data with the matrix it was taken from.
+ */
+void unview_matrix(parameters *params){
+    mat_t *copy = mat_dup(matrix_data(params, 2));
+    if (copy == NULL){
+        report_failure(params, mat_strerror(MAT_ERR_ALLOC));
+        return;
     }
-    free_matrix(matrix_data(params, 2), size);
-    (params->matrices)[(params->mat_selection)[2]].data = temp_matrix;
+    mat_free(matrix_data(params, 2));
+    (params->matrices)[(params->mat_selection)[2]].data = copy;
 }
\ No newline at end of file
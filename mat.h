@@ -1,40 +1,133 @@
 #ifndef MAT_H
 #define MAT_H
 
-    typedef float **matrix;
+#include <stdio.h>
+#include "libmat.h"
 
+#define MATRIX_COUNT 6
+#define MAX_MAP_STAGES 8
+
+    /*
+     * mat:
+     * a named matrix of the calculator, the data member is a handle
+     * to the matrix engine in "libmat.h".
+     */
     typedef struct mat {
         char *name;
-        matrix data;
+        mat_t *data;
     } mat;
     
+    /*
+     * session:
+     * the streams a user of the calculator works through: the standard
+     * input and output, or a connection to the server (see "server.h"),
+     * the format of the errors reported to it (see "report.h"), and the
+     * line being processed: it is read whole from the input first, then
+     * parsed from memory, "length" is its length (including the line
+     * break which ends it) and "column" the position the parser reached.
+     * "files" is 1 if the session may run the commands which read and
+     * write files in its name ("checkpoint" and "restore").
+     */
+    typedef struct session {
+        FILE *in;
+        FILE *out;
+        int errors;
+        int files;
+        char *line;
+        int length;
+        int column;
+        long line_number;
+    } session;
+
+    /*
+     * slice:
+     * the block selected by the "view" command, resolved against the
+     * shape of the viewed matrix: the first selected row, how many rows
+     * are selected and the step between them, the same for the columns,
+     * and whether the block is presented transposed.
+     */
+    typedef struct slice {
+        int row, rows, row_step;
+        int col, cols, col_step;
+        int transpose;
+    } slice;
+
+    /*
+     * map_stage:
+     * an operation of the "map" command (see "mat_map"): "operand" is
+     * the index of the matrix it takes, or -1 if it takes the number
+     * "scalar" instead, "scalar" and "limit" are the bounds of a clamp.
+     */
+    typedef struct map_stage {
+        mat_map_op op;
+        int operand;
+        float scalar, limit;
+    } map_stage;
+
     /*
      * parameters:
      * func_selection: the index of the selected function
      * scalar_input: the floating point number supplied by the user
      * elements: array that stores the matrix elements
+     * elements_count: the number of elements in the array, the
+     * size of the output matrix when they were read.
      * mat_selection: an array which contains the the indexes
      * of the selected matrices: 0 and 1 holds the indexes
      * of the input matrices and 2 holds the index of the desired
-     * output matrix.
-     * matrices: the array of 6 matrices, created when the program
-     * is initialized.
+     * output matrix, 3 holds the second output, if there is one.
+     * matrices: the array of MATRIX_COUNT matrices, created when the
+     * program is initialized.
+     * view: the block selected by the "view" command.
+     * path: the file name supplied by the user.
+     * stages: the operations of the "map" command, "stages_count" of
+     * them.
+     * line_number: the number of the input line being processed.
+     * out: the stream the results and errors are printed to.
+     * errors: the format of the errors (see "report.h").
      */
     typedef struct parameters {
         int func_selection;
         float scalar_input;
         float *elements;
+        int elements_count;
         int *mat_selection;
         mat *matrices;
+        slice *view;
+        char *path;
+        map_stage *stages;
+        int stages_count;
+        long line_number;
+        FILE *out;
+        int errors;
     } parameters;
     
-    matrix create_matrix(int);
-    void free_matrix(matrix, int);
-    void print_matrix(parameters* , int);
-    void mul_matrix(parameters*, int);
-    void add_matrix(parameters*, int);
-    void sub_matrix(parameters*, int);
-    void mul_scalar(parameters*, int);
-    void trans_matrix(parameters*, int);
+    void print_matrix(parameters*);
+    void mul_matrix(parameters*);
+    void add_matrix(parameters*);
+    void sub_matrix(parameters*);
+    void mul_scalar(parameters*);
+    void trans_matrix(parameters*);
+    void lu_matrix(parameters*);
+    void chol_matrix(parameters*);
+    void qr_matrix(parameters*);
+    void solve_matrix(parameters*);
+    void inv_matrix(parameters*);
+    void det_matrix(parameters*);
+    void sum_matrix(parameters*);
+    void norm_matrix(parameters*);
+    void norm1_matrix(parameters*);
+    void norminf_matrix(parameters*);
+    void trace_matrix(parameters*);
+    void minmax_matrix(parameters*);
+    void sum_rows_matrix(parameters*);
+    void sum_cols_matrix(parameters*);
+    void mul_elem_matrix(parameters*);
+    void div_elem_matrix(parameters*);
+    void exp_matrix(parameters*);
+    void relu_matrix(parameters*);
+    void map_matrix(parameters*);
+    void copy_matrix(parameters*, const mat_t*);
+    void view_matrix(parameters*);
+    void unview_matrix(parameters*);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mat.h"
+#include "memo.h"
+
+#define MEMO_ENTRIES 16
+#define MEMO_MAX_ELEMENTS (1L << 22)
+
+/*
+ * memo_entry:
+ * a result kept by the cache, along with what it was computed from:
+ * the selected function, the id and version of each input matrix (see
+ * "mat_version") and the scalar, if the function takes one. an entry
+ * can only match while its inputs are unchanged, stale entries are
+ * never removed explicitly, they just age out. "last_used" is the
+ * clock tick of the last lookup that found it, 0 marks a free entry.
+ * the scalars are compared bit by bit: -0 and 0 are equal as floats,
+ * but scaling by them gives results of different signs.
+ */
+typedef struct memo_entry {
+    int func_selection;
+    int inputs;
+    unsigned long ids[2];
+    unsigned long versions[2];
+    float scalar;
+    unsigned long last_used;
+    mat_t *result;
+} memo_entry;
+
+/*
+ * the cache: at most MEMO_ENTRIES results, holding at most
+ * MEMO_MAX_ELEMENTS elements together, the least recently used
+ * entries are evicted first. the sessions of the server (see
+ * "server.h") share it, so it is guarded by "memo_lock", which is
+ * not held while a missing result is computed.
+ */
+static memo_entry entries[MEMO_ENTRIES];
+static long cached_elements;
+static unsigned long clock_tick, hits, misses;
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * make_key:
+ * an auxiliary function
+ * fills the key fields of "key" from the parameters of the call.
+ */
+static void make_key(memo_entry *key, parameters *params, int inputs, int takes_scalar){
+    int i;
+    mat_t *input;
+    key->func_selection = params->func_selection;
+    key->inputs = inputs;
+    for(i = 0; i < inputs; i++){
+        input = (params->matrices)[(params->mat_selection)[i]].data;
+        key->ids[i] = mat_id(input);
+        key->versions[i] = mat_version(input);
+    }
+    key->scalar = takes_scalar ? params->scalar_input : 0.0f;
+    key->last_used = 0;
+    key->result = NULL;
+}
+
+/*
+ * find_entry:
+ * an auxiliary function
+ * returns the entry matching the key fields of "key", or NULL.
+ */
+static memo_entry *find_entry(memo_entry *key){
+    int i, j;
+    memo_entry *e;
+    for(i = 0; i < MEMO_ENTRIES; i++){
+        e = &entries[i];
+        if (!e->last_used || e->func_selection != key->func_selection ||
+                e->inputs != key->inputs || memcmp(&e->scalar, &key->scalar, sizeof(float)))
+            continue;
+        for(j = 0; j < e->inputs && e->ids[j] == key->ids[j] && e->versions[j] == key->versions[j]; j++)
+            ;
+        if (j == e->inputs)
+            return e;
+    }
+    return NULL;
+}
+
+/*
+ * evict:
+ * an auxiliary function
+ * frees the least recently used entry, returns it.
+ */
+static memo_entry *evict(void){
+    int i;
+    memo_entry *lru = &entries[0];
+    for(i = 1; i < MEMO_ENTRIES; i++){
+        if (entries[i].last_used < lru->last_used)
+            lru = &entries[i];
+    }
+    if (lru->last_used){
+        cached_elements -= (long)mat_rows(lru->result) * mat_cols(lru->result);
+        mat_free(lru->result);
+        lru->last_used = 0;
+    }
+    return lru;
+}
+
+/*
+ * insert_entry:
+ * an auxiliary function
+ * saves a copy of "result" under the key fields of "key", evicting
+ * entries until both the entry and its elements fit.
+ */
+static void insert_entry(memo_entry *key, mat_t *result){
+    int i;
+    memo_entry *e = NULL;
+    long size = (long)mat_rows(result) * mat_cols(result);
+    if (size > MEMO_MAX_ELEMENTS)
+        return;
+    while(cached_elements + size > MEMO_MAX_ELEMENTS)
+        evict();
+    for(i = 0; i < MEMO_ENTRIES && e == NULL; i++){
+        if (!entries[i].last_used)
+            e = &entries[i];
+    }
+    if (e == NULL)
+        e = evict();
+    *e = *key;
+    if ((e->result = mat_dup(result)) == NULL)
+        return;
+    e->last_used = ++clock_tick;
+    cached_elements += size;
+}
+
+/*
+ * memo_call:
+ * calls "func", which reads "inputs" input matrices (and a scalar if
+ * "takes_scalar" is set) and writes the output matrix, through the
+ * cache: if the same function was already called with the same
+ * inputs, in the same versions, the cached result is copied to the
+ * output instead. otherwise the function is called, and if it wrote
+ * its output (it didn't fail), a copy of the result is cached.
+ */
+void memo_call(parameters *params, void (*func)(parameters*), int inputs, int takes_scalar){
+    memo_entry key, *e;
+    mat_t *output = (params->matrices)[(params->mat_selection)[2]].data;
+    unsigned long id = mat_id(output), version = mat_version(output);
+    make_key(&key, params, inputs, takes_scalar);
+    pthread_mutex_lock(&memo_lock);
+    if ((e = find_entry(&key)) != NULL){
+        hits++;
+        e->last_used = ++clock_tick;
+        copy_matrix(params, e->result);
+        pthread_mutex_unlock(&memo_lock);
+        return;
+    }
+    misses++;
+    pthread_mutex_unlock(&memo_lock);
+    func(params);
+    output = (params->matrices)[(params->mat_selection)[2]].data;
+    pthread_mutex_lock(&memo_lock);
+    if ((mat_id(output) != id || mat_version(output) != version) && find_entry(&key) == NULL)
+        insert_entry(&key, output);
+    pthread_mutex_unlock(&memo_lock);
+}
+
+/*
+ * print_memo_stats:
+ * prints how many calls were answered from the cache.
+ */
+void print_memo_stats(parameters *params){
+    unsigned long calls, hit_count, miss_count;
+    pthread_mutex_lock(&memo_lock);
+    hit_count = hits;
+    miss_count = misses;
+    pthread_mutex_unlock(&memo_lock);
+    calls = hit_count + miss_count;
+    fprintf(params->out, "cache: %lu hits, %lu misses, hit rate %.1f%%\n", hit_count, miss_count,
+            calls ? 100.0 * hit_count / calls : 0.0);
+}
@@ -0,0 +1,9 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "mat.h"
+
+    void memo_call(parameters*, void (*)(parameters*), int, int);
+    void print_memo_stats(parameters*);
+
+#endif
@@ -2,19 +2,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include "mat.h"
+#include "memo.h"
+#include "patch.h"
+#include "report.h"
+#include "checkpoint.h"
+#include "registry.h"
+#include "server.h"
 
 #define DEFAULT_SIZE 4
 #define MAX_BUFFER_SIZE 100
 #define MAX_LINE_SIZE 2048
-#define MATRIX_COUNT 6
-#define FUNCTIONS_COUNT 8
+#define MAX_FRACTION_DIGITS 30
+#define FUNCTIONS_COUNT 35
+#define CHECKPOINT_INTERVAL 1000
 
 /*
  * func:
  * a structure which contains some function meta data,
  * like its name (represented by a string), how many
- * of each type of input it takes, and a pointer to it.
+ * of each type of input it takes, how many matrices it
+ * outputs, whether it reads a file name, which part of a matrix it
+ * patches (see "patch.h", 0 if it doesn't), whether it reads the
+ * operations of the "map" command, whether it reads (1) or
+ * writes (2) all the matrices, whether its results may be cached
+ * (see "memo.h"), and a pointer to it.
  * this is used only in this source file, so it's not included
  * in the header "mat.h".
  */
@@ -22,10 +35,16 @@ typedef struct func {
         char *name;
         int mat_input;
         unsigned int takes_scalar : 1;
-        unsigned int has_output : 1;
+        unsigned int mat_output : 2;
         unsigned int reads_floats : 1;
+        unsigned int reads_view : 1;
+        unsigned int reads_path : 1;
+        unsigned int reads_patch : 2;
+        unsigned int reads_map : 1;
+        unsigned int all_matrices : 2;
+        unsigned int memoize : 1;
         int parameters_count;
-        void (*func)(parameters*, int);
+        void (*func)(parameters*);
     } func;
 
 /*
@@ -34,45 +53,123 @@ typedef struct func {
  * functions in the "mat.c" file.
  */
 const func functions_list[] = {
-                            {"read_mat", 0, 0, 1, 1, 2, NULL},
-                            {"print_mat", 1, 0, 0, 0, 1, print_matrix},
-                            {"add_mat", 2, 0, 1, 0, 3, add_matrix},
-                            {"sub_mat", 2, 0, 1, 0, 3, sub_matrix},
-                            {"mul_mat", 2, 0, 1, 0, 3, mul_matrix},
-                            {"mul_scalar", 1, 1, 1, 0, 3, mul_scalar},
-                            {"trans_mat", 1, 0, 1, 0, 2, trans_matrix},
-                            {"stop", 0, 0, 0, 0, 0, NULL}};
-
-parameters pack_parameters(int, float, float*, int*, mat*);
+                            {"read_mat", 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 2, NULL},
+                            {"print_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, print_matrix},
+                            {"add_mat", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, add_matrix},
+                            {"sub_mat", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, sub_matrix},
+                            {"mul_mat", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, mul_matrix},
+                            {"mul_scalar", 1, 1, 1, 0, 0, 0, 0, 0, 0, 1, 3, mul_scalar},
+                            {"trans_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, trans_matrix},
+                            {"lu_mat", 1, 0, 2, 0, 0, 0, 0, 0, 0, 0, 3, lu_matrix},
+                            {"chol_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, chol_matrix},
+                            {"qr_mat", 1, 0, 2, 0, 0, 0, 0, 0, 0, 0, 3, qr_matrix},
+                            {"solve_mat", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, solve_matrix},
+                            {"inv_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, inv_matrix},
+                            {"det_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, det_matrix},
+                            {"sum_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, sum_matrix},
+                            {"norm_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, norm_matrix},
+                            {"norm1_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, norm1_matrix},
+                            {"norminf_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, norminf_matrix},
+                            {"trace_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, trace_matrix},
+                            {"minmax_mat", 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, minmax_matrix},
+                            {"sum_rows_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, sum_rows_matrix},
+                            {"sum_cols_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, sum_cols_matrix},
+                            {"view", 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 2, view_matrix},
+                            {"unview", 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, unview_matrix},
+                            {"cache_stats", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, print_memo_stats},
+                            {"checkpoint", 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 1, checkpoint_matrices},
+                            {"restore", 0, 0, 0, 0, 0, 1, 0, 0, 2, 0, 1, restore_matrices},
+                            {"set_row", 0, 0, 0, 0, 0, 0, PATCH_ROW, 0, 2, 0, 2, patch_matrix},
+                            {"set_col", 0, 0, 0, 0, 0, 0, PATCH_COL, 0, 2, 0, 2, patch_matrix},
+                            {"set_block", 0, 0, 0, 0, 0, 0, PATCH_BLOCK, 0, 2, 0, 2, patch_matrix},
+                            {"mul_elem", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, mul_elem_matrix},
+                            {"div_elem", 2, 0, 1, 0, 0, 0, 0, 0, 0, 1, 3, div_elem_matrix},
+                            {"exp_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, exp_matrix},
+                            {"relu_mat", 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 2, relu_matrix},
+                            {"map", 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 2, map_matrix},
+                            {"stop", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, NULL}};
+
+/*
+ * options:
+ * the command line options: the file the calculator state is saved to
+ * every "checkpoint_interval" lines and when the program stops (NULL
+ * if it isn't), the file to resume from (NULL to start afresh), the
+ * Unix domain socket or the port to serve on (NULL and 0 to read the
+ * standard input instead), the number of threads of the compute
+ * pool of the engine and the number of its worker processes (0 for
+ * none), where the engine places large matrices in memory, how far
+ * apart it pins the pool threads (0 not to pin them) and the format of
+ * the errors (see "report.h").
+ */
+typedef struct options {
+        char *checkpoint_path;
+        long checkpoint_interval;
+        char *restore_path;
+        char *socket_path;
+        int port;
+        int threads;
+        int workers;
+        mat_placement placement;
+        int pin_step;
+        int errors;
+    } options;
+
+void default_options(options*);
+int read_options(int, char**, options*);
+parameters pack_parameters(int, float, float*, int, int*, mat*, slice*, char*, map_stage*, int, long, FILE*, int);
 int is_legal_mat_char(int);
-int read_next_mat_string(char*);
-int read_float(float*);
-int skip_whites(void);
-void skip_line(void);
-int peek_next_char(void);
+int read_next_mat_string(session*, char*);
+int read_float(session*, float*);
+int skip_whites(session*);
+void skip_line(session*);
+int read_char(session*);
+void unread_char(session*, int);
+int peek_next_char(session*);
 int select_function(char*);
-void read_command(char*);
-void read_mat_parameter_error_check(int, int, char*, int, int, int*);
-int read_mat_parameter(mat*, int, int*);
-void read_scalar_parameter_error_check(int, int, int*);
-void read_scalar_parameter(float*, int*);
-void read_mat_elements_error_check(int, int, int, int);
-void read_mat_elements(float*);
+int find_matrix(mat*, char*);
+void read_command(session*, char*);
+void read_mat_parameter_error_check(session*, int, int, char*, int, int, int*);
+int read_mat_parameter(session*, mat*, int, int*);
+void read_scalar_parameter_error_check(session*, int, int, int*);
+void read_scalar_parameter(session*, float*, int*);
+int read_mat_elements_error_check(session*, int, int, int, int, int);
+int read_mat_elements(session*, float*, int);
+int view_error(session*, report_code, char*, char*);
+int read_index(session*, int*);
+int read_range(session*, int, int*, int*, int*);
+int read_view_parameters(session*, int*, slice*, mat*);
+int read_path_parameter(session*, char*);
+int read_patch_parameters(session*, int, int*, slice*, float**, int*, mat*);
+int read_map_operand(session*, map_stage*, mat*);
+int read_map_parameters(session*, int*, map_stage*, int*, mat*);
 void stop(int*);
-int check_comma_error(void);
-int read_parameters(int, int*, float*, float*, mat*);
-void read_mat(int, float*, mat*);
+int check_comma_error(session*);
+int read_parameters(session*, int, int*, float*, float**, int*, slice*, char*, map_stage*, int*, mat*);
+void read_mat(parameters*);
 void call_function(parameters*, int*);
-int pre_process_line(int*);
-void process_line(mat*, int*);
-void mat_calculator(void);
+int pre_process_line(session*, int*);
+void select_locks(int, int*, int*);
+void process_line(session*, mat*, long, int*);
+void auto_checkpoint(session*, options*, mat*, long);
+int resume(session*, char*, mat*, long*);
+void run_session(session*, mat*, options*, long);
+void serve_session(session*, mat*);
+void start_server(session*, options*, mat*);
+void mat_calculator(options*);
 
 /*
- * main function calls "mat_calculator", which calls the main processing
- * functions.
+ * main function reads the command line options, then calls "mat_calculator",
+ * which calls the main processing functions.
  */
 int main(int argc, char** argv) {
-    
+    options opts;
+
+    if (!read_options(argc, argv, &opts)){
+        printf("Usage: %s [-c checkpoint_file [-n lines]] [-r checkpoint_file]\n"
+               "       [-s socket_file | -p port] [-t threads] [-w workers]\n"
+               "       [-m local|partition|interleave] [-b cpu_step] [-e text|json]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
     puts("This is the simple matrix calculator program.\n"
          "Please enter your input line by line, each line\n"
          "must be terminated with a line break. the marker\n"
@@ -83,11 +180,112 @@ int main(int argc, char** argv) {
          "When you're done, please terminate the program by calling\n"
          "the \"stop\" command.");
     
-    mat_calculator();
+    mat_calculator(&opts);
 
     return (EXIT_SUCCESS);
 }
 
+/*
+ * default_options:
+ * sets "opts" to what the calculator does without command line options:
+ * no checkpoints, no server, no pool or workers, the local placement
+ * and the errors as text.
+ */
+void default_options(options *opts){
+    opts->checkpoint_path = opts->restore_path = opts->socket_path = NULL;
+    opts->checkpoint_interval = CHECKPOINT_INTERVAL;
+    opts->port = opts->threads = opts->workers = opts->pin_step = 0;
+    opts->placement = MAT_PLACE_LOCAL;
+    opts->errors = REPORT_TEXT;
+}
+
+/*
+ * read_options:
+ * reads the command line options into "opts" (see "default_options" for
+ * the options not given): "-c file" saves the calculator state to
+ * "file" every CHECKPOINT_INTERVAL lines (or every "lines" lines, given
+ * with "-n lines") and when the program stops,
+ * "-r file" restores the state saved in "file" and resumes the input
+ * after the line it was saved at. "-s file" serves the calculator on
+ * the Unix domain socket "file", "-p port" on "port" of the loopback
+ * interface, instead of reading the standard input ("-r" then only
+ * restores the matrices, "-c" is not allowed). "-t threads" starts a
+ * compute pool of that many threads, "-w workers" starts that many
+ * worker processes that large products are split among. "-m policy"
+ * places large matrices (see "mat_placement"), "-b step" pins pool
+ * thread i to CPU i * step, "-e json" reports the errors as JSON
+ * objects (see "report.h"). "-t", "-w", "-m" and "-b" change nothing
+ * for the DEFAULT_SIZE matrices of the calculator, far below the sizes
+ * that are split or placed, they're checked by "make grid-check" and
+ * "make place-check". returns 1 if the options are OK, 0 otherwise.
+ */
+int read_options(int argc, char **argv, options *opts){
+    int i;
+    char *end;
+    default_options(opts);
+    for(i = 1; i < argc; i++){
+        if (i + 1 == argc || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0')
+            return 0;
+        switch(argv[i++][1]){
+            case 'c':
+                opts->checkpoint_path = argv[i];
+                break;
+            case 'n':
+                opts->checkpoint_interval = strtol(argv[i], &end, 10);
+                if (*end != '\0' || opts->checkpoint_interval <= 0)
+                    return 0;
+                break;
+            case 'r':
+                opts->restore_path = argv[i];
+                break;
+            case 's':
+                opts->socket_path = argv[i];
+                break;
+            case 'p':
+                opts->port = (int)strtol(argv[i], &end, 10);
+                if (*end != '\0' || opts->port <= 0 || opts->port > 65535)
+                    return 0;
+                break;
+            case 't':
+                opts->threads = (int)strtol(argv[i], &end, 10);
+                if (*end != '\0' || opts->threads < 0)
+                    return 0;
+                break;
+            case 'w':
+                opts->workers = (int)strtol(argv[i], &end, 10);
+                if (*end != '\0' || opts->workers < 0)
+                    return 0;
+                break;
+            case 'm':
+                if (!strcmp(argv[i], "local"))
+                    opts->placement = MAT_PLACE_LOCAL;
+                else if (!strcmp(argv[i], "partition"))
+                    opts->placement = MAT_PLACE_PARTITION;
+                else if (!strcmp(argv[i], "interleave"))
+                    opts->placement = MAT_PLACE_INTERLEAVE;
+                else
+                    return 0;
+                break;
+            case 'b':
+                opts->pin_step = (int)strtol(argv[i], &end, 10);
+                if (*end != '\0' || opts->pin_step < 0)
+                    return 0;
+                break;
+            case 'e':
+                if (!strcmp(argv[i], "text"))
+                    opts->errors = REPORT_TEXT;
+                else if (!strcmp(argv[i], "json"))
+                    opts->errors = REPORT_JSON;
+                else
+                    return 0;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return !((opts->socket_path != NULL || opts->port) && opts->checkpoint_path != NULL);
+}
+
 /*
  * pack_parameters:
  * this function takes the various data structures read from the input,
@@ -95,13 +293,23 @@ int main(int argc, char** argv) {
  * functions selected by the user. 
  */
 parameters pack_parameters(int func_selection, float scalar_input, float *elements,
-                            int *mat_selection, mat *matrices){
+                            int elements_count, int *mat_selection, mat *matrices,
+                            slice *view, char *path, map_stage *stages, int stages_count,
+                            long line_number, FILE *out, int errors){
     parameters result;
     result.func_selection = func_selection;
     result.scalar_input = scalar_input;
     result.elements = elements;
+    result.elements_count = elements_count;
     result.mat_selection = mat_selection;
     result.matrices = matrices;
+    result.view = view;
+    result.path = path;
+    result.stages = stages;
+    result.stages_count = stages_count;
+    result.line_number = line_number;
+    result.out = out;
+    result.errors = errors;
     return result;
 }
 /*
@@ -121,15 +329,17 @@ int is_legal_mat_char(int c){
  * takes a char array in which it saves the matrix name read from stdin,
  * then adds a '\0', returns the last non upper case nor under score
  * character to the caller, also returns it to the buffer, so it can
- * be processed by the next function.
+ * be processed by the next function. a name longer than the array
+ * (MAX_BUFFER_SIZE) is cut short, no matrix has such a name anyway.
  */
-int read_next_mat_string(char *string){
+int read_next_mat_string(session *ses, char *string){
     int c, i;
-    for(i= 0; is_legal_mat_char((c = getc(stdin))); ){
-        string[i++] = c;
+    for(i= 0; is_legal_mat_char((c = read_char(ses))); ){
+        if (i < MAX_BUFFER_SIZE - 1)
+            string[i++] = c;
     }
     string[i] = '\0';
-    ungetc(c, stdin);
+    unread_char(ses, c);
     return c;
 }
 
@@ -140,26 +350,30 @@ int read_next_mat_string(char *string){
  * were supplied with no digits, which could have been counted as 0,
  * but actually is an illegal character when no digits are present in
  * the right places. this function is used instead of "atof" from the
- * standard library.
+ * standard library. fraction digits past MAX_FRACTION_DIGITS are read
+ * but ignored, they can't change a float, and would only overflow
+ * "power".
  */
-int read_float(float *result){
-    float val, power = 1.0;
-    int i, sign = 1, c = getc(stdin), digits_count = 0;
+int read_float(session *ses, float *result){
+    float val = 0.0, power = 1.0;
+    int sign = 1, c = read_char(ses), digits_count = 0, fraction_digits = 0;
     if (c == '-'){
         sign = -1;
-        c = getc(stdin);
+        c = read_char(ses);
     }
     while(isdigit(c)){
         val = 10.0 * val + (c - '0');
-        c = getc(stdin);
+        c = read_char(ses);
         digits_count++;
     }
     if (c == '.')
-        for (power = 1.0; isdigit((c = getc(stdin))); i++, digits_count++) {
-            val = 10.0 * val + (c - '0');
-            power *= 10.0;
+        for (power = 1.0; isdigit((c = read_char(ses))); fraction_digits++, digits_count++) {
+            if (fraction_digits < MAX_FRACTION_DIGITS){
+                val = 10.0 * val + (c - '0');
+                power *= 10.0;
+            }
         }
-    ungetc(c, stdin);
+    unread_char(ses, c);
     *result = sign * val / power;
     return digits_count;
 }
@@ -169,27 +383,43 @@ int read_float(float *result){
  * skips spaces and tabs, returns the first non space nor tab char
  * it reads to the caller and to the stdin.
  */
-int skip_whites(void){
+int skip_whites(session *ses){
     int c;
-    while((c = getc(stdin)) == '\t' || c == ' ')
+    while((c = read_char(ses)) == '\t' || c == ' ')
         ;
-    ungetc(c, stdin);
+    unread_char(ses, c);
     return c;
 }
 
 /*
  * skip_line:
  * it skips and consumes all the characters until a line break is
- * detected (which is also consumed), EOF is not used here since the 
- * function "pre_process_line" makes sure that the program is stopped
- * before processing a line terminated with EOF.
+ * detected (which is also consumed), that is, the rest of the line,
+ * which "pre_process_line" makes sure ends with a line break.
  */
-void skip_line(void){
-    int c;
-    while((c = getc(stdin)) != '\n' && c != EOF)
-        ;
-    if (c == EOF)
-        ungetc(c, stdin);
+void skip_line(session *ses){
+    ses->column = ses->length;
+}
+
+/*
+ * read_char:
+ * reads the next char of the line being processed, like "getc" does
+ * from a stream, returns EOF past the line break which ends it.
+ */
+int read_char(session *ses){
+    if (ses->column >= ses->length)
+        return EOF;
+    return (unsigned char)ses->line[ses->column++];
+}
+
+/*
+ * unread_char:
+ * returns the char "c" last read by "read_char" to the line, like
+ * "ungetc" does, EOF is ignored.
+ */
+void unread_char(session *ses, int c){
+    if (c != EOF && ses->column > 0)
+        ses->column--;
 }
 
 /*
@@ -197,11 +427,11 @@ void skip_line(void){
  * skips spaces and tabs, then reads the next char, returns it to the
  * user and the buffer (stdin).
  */
-int peek_next_char(void){
+int peek_next_char(session *ses){
     int c;
-    skip_whites();
-    c = getc(stdin);
-    ungetc(c, stdin);
+    skip_whites(ses);
+    c = read_char(ses);
+    unread_char(ses, c);
     return c;
 }
 
@@ -220,16 +450,35 @@ int select_function(char *command){
     return i;
 }
 
+/*
+ * find_matrix:
+ * finds the index of the matrix named "name" in the "matrices" array,
+ * if not found, the index returned is MATRIX_COUNT.
+ */
+int find_matrix(mat *matrices, char *name){
+    int i;
+    for(i = 0; i < MATRIX_COUNT; i++){
+        if (!strcmp(name, matrices[i].name))
+            break;
+    }
+    return i;
+}
+
 /*
  * read_command:
- * read the first string in a line, saves it in the command pointer.
- * since it uses "fscanf", it skips all the whites, including line breaks, until it reads 
- * a string.
+ * read the first string in a line, up to the next white, saves it in
+ * the command pointer (cut short at MAX_BUFFER_SIZE chars, no command
+ * is that long), it's empty if the line is blank.
  */
-void read_command(char *command){
-    skip_whites();
-    fscanf(stdin,"%s",command);
-    skip_whites();
+void read_command(session *ses, char *command){
+    int c, i = 0;
+    skip_whites(ses);
+    while((c = read_char(ses)) != EOF && !isspace(c))
+        if (i < MAX_BUFFER_SIZE - 1)
+            command[i++] = c;
+    command[i] = '\0';
+    unread_char(ses, c);
+    skip_whites(ses);
 }
 
 /*
@@ -241,24 +490,24 @@ void read_command(char *command){
  * one. the order of the errors is set in a way which prints the first
  * relevant error message and doesn't report any additional errors.
  */
-void read_mat_parameter_error_check(int index, int p_count, char *mat_name, int parameter_length, int next_char, int *status){
-    int c = peek_next_char();
+void read_mat_parameter_error_check(session *ses, int index, int p_count, char *mat_name, int parameter_length, int next_char, int *status){
+    int c = peek_next_char(ses);
     *status = 0;
     if (p_count == 1 && c != '\n' && index < 6)
-        printf("Error: extraneous text at end of command\n");
+        report_error(ses, REPORT_EXTRANEOUS_TEXT, "extraneous text at end of command");
     else if (p_count > 1 && is_legal_mat_char(c) && index < 6)
-        printf("Error: missing comma\n");
+        report_error(ses, REPORT_MISSING_COMMA, "missing comma");
     else if (c == '\n' && (parameter_length == 0 || (p_count > 1 && index < 6)))
-        printf("Error: too few arguments\n");
+        report_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments");
     else if (parameter_length == 0 && c == ',')
-        printf("Error: multiple consecutive commas\n");
+        report_error(ses, REPORT_CONSECUTIVE_COMMAS, "multiple consecutive commas");
     else if (!is_legal_mat_char(c) &&  index < 6)
-        printf("Error: illegal char \"%c\" following matrix name\n", c);
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \"%c\" following matrix name", c);
     else if (index > 5 && (next_char == '\n' || next_char == ' ' || next_char == '\t' || next_char == ','))
-        printf("Error: unknown matrix \"%s\"\n",mat_name);
+        report_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", REPORT_MAX_QUOTE, mat_name);
     else if (!is_legal_mat_char(c))
-        printf("Error: matrix name should only contain upper case letters and underscores\n");
-    skip_line();
+        report_error(ses, REPORT_ILLEGAL_NAME, "matrix name should only contain upper case letters and underscores");
+    skip_line(ses);
 }
 
 /*
@@ -269,29 +518,27 @@ void read_mat_parameter_error_check(int index, int p_count, char *mat_name, int
  * to be read or a comma if there are still additional parameters to be
  * read. if the matrix name is not correct or any other illegal characters
  * present the error checking function is called with the calculated parameters.
- * the result (selection) is saved in "matrices" array, which contains three
- * places: 0 and 1 for the input matrices, and 2 for the output. this
- * is the maximum number of input and output matrices any function uses.
+ * the result (selection) is saved in "matrices" array, which contains four
+ * places: 0 and 1 for the input matrices, 2 for the output and 3 for the
+ * second output. this is the maximum number of input and output matrices
+ * any function uses.
  * p_count is the number of remaining parameters to be read and status
  * is a flag parameter, 1 means that everything is OK, 0 otherwise.
  */
-int read_mat_parameter(mat *matrices, int p_count, int *status){
+int read_mat_parameter(session *ses, mat *matrices, int p_count, int *status){
     int i, next_char;
     char mat_name[MAX_BUFFER_SIZE];
-    next_char = read_next_mat_string(mat_name);
-    for(i = 0; i < MATRIX_COUNT; i++){
-        if (!strcmp(mat_name, matrices[i].name))
-            break;
-    }
-    skip_whites();
-    if (p_count == 1 && i < 6 && peek_next_char() == '\n')
-        skip_line();
-    else if (p_count > 1 && i < 6 && peek_next_char() == ','){
-        getc(stdin);
-        skip_whites();
+    next_char = read_next_mat_string(ses, mat_name);
+    i = find_matrix(matrices, mat_name);
+    skip_whites(ses);
+    if (p_count == 1 && i < 6 && peek_next_char(ses) == '\n')
+        skip_line(ses);
+    else if (p_count > 1 && i < 6 && peek_next_char(ses) == ','){
+        read_char(ses);
+        skip_whites(ses);
     }
     else
-        read_mat_parameter_error_check(i, p_count, mat_name, strlen(mat_name), next_char, status);
+        read_mat_parameter_error_check(ses, i, p_count, mat_name, strlen(mat_name), next_char, status);
     return i;
 }
 
@@ -302,21 +549,21 @@ int read_mat_parameter(mat *matrices, int p_count, int *status){
  * parameter reading and skips line. the input parameters are calculated
  * by the scalar reading function, which is also the caller.
  */
-void read_scalar_parameter_error_check(int digits_count, int c, int *status){
+void read_scalar_parameter_error_check(session *ses, int digits_count, int c, int *status){
     int next_char;
     *status = 0;
-    next_char = peek_next_char();
+    next_char = peek_next_char(ses);
     if ((c == '.' || c == '-') && !digits_count)
-        printf("Error: illegal char \'%c\'\n",c);
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\'",c);
     else if (!digits_count && next_char == ',')
-        printf("Error: multiple consecutive commas\n");
+        report_error(ses, REPORT_CONSECUTIVE_COMMAS, "multiple consecutive commas");
     else if (next_char == '\n')
-        printf("Error: too few arguments\n");
+        report_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments");
     else if (digits_count)
-        printf("Error: illegal char \'%c\' following scalar\n",c);
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\' following scalar",c);
     else
-        printf("Error: illegal char \'%c\'\n",c);
-    skip_line();
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\'",c);
+    skip_line(ses);
 }
 
 /*
@@ -327,18 +574,18 @@ void read_scalar_parameter_error_check(int digits_count, int c, int *status){
  * point number followed by a comma triggers the error checking function
  * to determine the source of the error.
  */
-void read_scalar_parameter(float *result, int *status){
+void read_scalar_parameter(session *ses, float *result, int *status){
     int c, digits_count;
     float temp;
-    c = peek_next_char();
-    digits_count = read_float(&temp);
-    if (digits_count && ((c = peek_next_char()) == ',')){
-        getc(stdin);
-        skip_whites();
+    c = peek_next_char(ses);
+    digits_count = read_float(ses, &temp);
+    if (digits_count && ((c = peek_next_char(ses)) == ',')){
+        read_char(ses);
+        skip_whites(ses);
         *result = temp;
     }
     else {
-        read_scalar_parameter_error_check(digits_count, c, status);
+        read_scalar_parameter_error_check(ses, digits_count, c, status);
     }
 }
 
@@ -347,49 +594,394 @@ void read_scalar_parameter(float *result, int *status){
  * this is an error checking function, called by "read_mat_elements",
  * which also calculates the input for this function. it determines
  * the source of the error when reading matrix elements, in case "read_mat"
- * was selected by the user.
- */
-void read_mat_elements_error_check(int c, int count, int prefix, int success){
-    if (count < 16){
-        if ((prefix == '.' || prefix == '-') && success == 0)
-            printf("Error: illegal char \'%c\', only %d elements read\n", prefix, count);
-        else if (isdigit(c) || c == '.' || c== '-')
-            printf("Error: matrix elements should be comma separated, only %d elements were read\n", count);
-        else if (c == '\n')
-            printf("Warning: too few elements, only %d elements read\n", count);
-        else if (c == ',')
-            printf("Warning: multiple consecutive commas, only %d elements read\n", count);
-        else
-            printf("Error: illegal char \'%c\', only %d elements read\n", c, count);
+ * was selected by the user, "expected" is the number of elements of the
+ * selected matrix. returns 0 for errors, 1 if the elements may still be
+ * used (nothing is wrong, or there are just too few of them).
+ */
+int read_mat_elements_error_check(session *ses, int c, int count, int expected, int prefix, int success){
+    if (count >= expected)
+        return 1;
+    if ((prefix == '.' || prefix == '-') && success == 0)
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\', only %d elements read", prefix, count);
+    else if (isdigit(c) || c == '.' || c== '-')
+        report_error(ses, REPORT_MISSING_COMMA, "matrix elements should be comma separated, only %d elements were read", count);
+    else if (c == '\n'){
+        report_warning(ses, REPORT_TOO_FEW_ELEMENTS, "too few elements, only %d elements read", count);
+        return 1;
+    }
+    else if (c == ','){
+        report_warning(ses, REPORT_CONSECUTIVE_COMMAS, "multiple consecutive commas, only %d elements read", count);
+        return 1;
     }
+    else
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\', only %d elements read", c, count);
+    return 0;
 }
 
 /*
  * read_mat_elements:
  * this function reads the floating pont numbers supplied by the user
- * from stdin, up to the point it detects an error or reads the maximum
- * number of elements allowed. if more input is present, the function
+ * from stdin, up to the point it detects an error or reads "count" elements,
+ * the number of elements of the selected matrix. if more input is present, the function
  * ignores it and skips to the next line.  if any error is detected before
- * the max number of elements is read, the values are stored in the
- * matrix selected by the user anyway and the error checking function
- * is called.
+ * the max number of elements is read, the error checking function is
+ * called, which tells whether the elements read may still be used (the
+ * rest are 0): returns 1 if they may, 0 if the command must not change
+ * anything.
  */
-void read_mat_elements(float *elements){
-    int i = 0, prefix, digits_count;
+int read_mat_elements(session *ses, float *elements, int count){
+    int i = 0, prefix, digits_count = 0, status;
     float temp;
-    prefix = peek_next_char();
-    while(i < DEFAULT_SIZE * DEFAULT_SIZE && (digits_count = read_float(&temp))){
+    prefix = peek_next_char(ses);
+    while(i < count && (digits_count = read_float(ses, &temp))){
         elements[i++] = temp;
-        if (peek_next_char() == ','){
-            getc(stdin);
-            prefix = peek_next_char();
+        if (peek_next_char(ses) == ','){
+            read_char(ses);
+            prefix = peek_next_char(ses);
         }
         else{
             break;
         }
     }
-    read_mat_elements_error_check(peek_next_char(), i, prefix,digits_count);
-    skip_line();
+    status = read_mat_elements_error_check(ses, peek_next_char(ses), i, count, prefix, digits_count);
+    skip_line(ses);
+    return status;
+}
+
+/*
+ * view_error:
+ * reports an error of code "code" found by "read_view_parameters" (or
+ * "read_path_parameter"), "format" may refer to "name" (the offending
+ * matrix name) with a "%.*s" (see "REPORT_MAX_QUOTE"), skips the line
+ * and returns 0, which is the status the caller should return.
+ */
+int view_error(session *ses, report_code code, char *format, char *name){
+    report_error(ses, code, format, REPORT_MAX_QUOTE, name);
+    skip_line(ses);
+    return 0;
+}
+
+/*
+ * read_index:
+ * reads a non negative integer from stdin and saves it in "result",
+ * returns the number of digits it read. an integer too large for an int
+ * is read as INT_MAX, which is out of the bounds of any matrix.
+ */
+int read_index(session *ses, int *result){
+    int c, digits_count = 0;
+    *result = 0;
+    while(isdigit((c = read_char(ses)))){
+        *result = *result <= (INT_MAX - 9) / 10 ? 10 * *result + (c - '0') : INT_MAX;
+        digits_count++;
+    }
+    unread_char(ses, c);
+    return digits_count;
+}
+
+/*
+ * read_range:
+ * reads a range of the form "start:stop:step" for a dimension of size
+ * "extent", start and stop may be omitted (they default to the whole
+ * dimension), as well as ":step", and a single index selects just that
+ * row or column. the range is saved as its first index, the number of
+ * indexes it selects and the step between them. returns 1 if the range
+ * is OK, 0 if it's malformed and -1 if it's out of bounds or empty.
+ */
+int read_range(session *ses, int extent, int *start, int *count, int *step){
+    int c, stop, has_start;
+    *step = 1;
+    skip_whites(ses);
+    has_start = read_index(ses, start);
+    skip_whites(ses);
+    if ((c = read_char(ses)) != ':'){
+        unread_char(ses, c);
+        if (!has_start)
+            return 0;
+        if (*start >= extent)
+            return -1;
+        stop = *start + 1;
+    }
+    else {
+        skip_whites(ses);
+        if (!read_index(ses, &stop))
+            stop = extent;
+        skip_whites(ses);
+        if ((c = read_char(ses)) == ':'){
+            skip_whites(ses);
+            if (!read_index(ses, step) || *step == 0)
+                return 0;
+            skip_whites(ses);
+        }
+        else
+            unread_char(ses, c);
+    }
+    if (*start >= stop || stop > extent)
+        return -1;
+    *count = (stop - *start - 1) / *step + 1;
+    return 1;
+}
+
+/*
+ * read_view_parameters:
+ * reads the parameters of the "view" command, which has its own syntax:
+ * "view MAT_X = MAT_Y[rows, cols]", optionally followed by a "'" to
+ * transpose the block, where rows and cols are ranges read by
+ * "read_range". the output matrix is saved in mat_selection[2], the
+ * viewed matrix in mat_selection[0] and the block in "view". returns
+ * the status: 1 if everything is OK, 0 otherwise (the error is reported
+ * and the line is skipped).
+ */
+int read_view_parameters(session *ses, int *mat_selection, slice *view, mat *matrices){
+    int range_status, rows, cols;
+    char mat_name[MAX_BUFFER_SIZE];
+    if (read_next_mat_string(ses, mat_name) == '\n' && !strlen(mat_name))
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if ((mat_selection[2] = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+        return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    if (peek_next_char(ses) != '=')
+        return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"=\" following matrix name", NULL);
+    read_char(ses);
+    skip_whites(ses);
+    read_next_mat_string(ses, mat_name);
+    if ((mat_selection[0] = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+        return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    if (peek_next_char(ses) != '[')
+        return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"[\" following matrix name", NULL);
+    read_char(ses);
+    lock_matrix(mat_selection[0], LOCK_READ);
+    rows = mat_rows(matrices[mat_selection[0]].data);
+    cols = mat_cols(matrices[mat_selection[0]].data);
+    unlock_matrix(mat_selection[0]);
+    range_status = read_range(ses, rows, &view->row, &view->rows, &view->row_step);
+    if (range_status == 1 && peek_next_char(ses) != ',')
+        return view_error(ses, REPORT_MISSING_COMMA, "missing comma", NULL);
+    if (range_status == 1){
+        read_char(ses);
+        range_status = read_range(ses, cols, &view->col, &view->cols, &view->col_step);
+    }
+    if (range_status == 0)
+        return view_error(ses, REPORT_ILLEGAL_RANGE, "illegal range", NULL);
+    if (range_status == -1)
+        return view_error(ses, REPORT_OUT_OF_BOUNDS, "range is out of the bounds of \"%.*s\"", mat_name);
+    if (peek_next_char(ses) != ']')
+        return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"]\" following range", NULL);
+    read_char(ses);
+    if ((view->transpose = peek_next_char(ses) == '\''))
+        read_char(ses);
+    if (peek_next_char(ses) != '\n')
+        return view_error(ses, REPORT_EXTRANEOUS_TEXT, "extraneous text at end of command", NULL);
+    skip_line(ses);
+    return 1;
+}
+
+/*
+ * read_patch_parameters:
+ * reads the parameters of the patch commands (see "patch.h"), of the
+ * form "set_row MAT_X, i, elements", "set_col MAT_X, j, elements" or
+ * "set_block MAT_X[rows, cols], elements", where rows and cols are
+ * ranges read by "read_range", without steps, followed by the elements
+ * of the row, column or block, read like those of "read_mat". the
+ * patched matrix is saved in mat_selection[0], the block in "view" and
+ * the elements in a new array, saved in "elements" (freed by the
+ * caller). returns the status: 1 if everything is OK, 0 otherwise (the
+ * error is reported and the line is skipped).
+ */
+int read_patch_parameters(session *ses, int kind, int *mat_selection, slice *view, float **elements,
+                          int *elements_count, mat *matrices){
+    int range_status = 1, rows, cols, *index;
+    char mat_name[MAX_BUFFER_SIZE];
+    if (read_next_mat_string(ses, mat_name) == '\n' && !strlen(mat_name))
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if ((mat_selection[0] = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+        return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    lock_matrix(mat_selection[0], LOCK_READ);
+    rows = mat_rows(matrices[mat_selection[0]].data);
+    cols = mat_cols(matrices[mat_selection[0]].data);
+    unlock_matrix(mat_selection[0]);
+    view->row = view->col = view->transpose = 0;
+    view->rows = rows;
+    view->cols = cols;
+    if (kind == PATCH_BLOCK){
+        if (peek_next_char(ses) != '[')
+            return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"[\" following matrix name", NULL);
+        read_char(ses);
+        range_status = read_range(ses, rows, &view->row, &view->rows, &view->row_step);
+        if (range_status == 1 && peek_next_char(ses) != ',')
+            return view_error(ses, REPORT_MISSING_COMMA, "missing comma", NULL);
+        if (range_status == 1){
+            read_char(ses);
+            range_status = read_range(ses, cols, &view->col, &view->cols, &view->col_step);
+        }
+        if (range_status == 1 && (view->row_step != 1 || view->col_step != 1))
+            range_status = 0;
+        if (range_status == 1 && peek_next_char(ses) != ']')
+            return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"]\" following range", NULL);
+        if (range_status == 1)
+            read_char(ses);
+    }
+    else {
+        if (peek_next_char(ses) != ',')
+            return view_error(ses, REPORT_MISSING_COMMA, "missing comma", NULL);
+        read_char(ses);
+        skip_whites(ses);
+        index = kind == PATCH_ROW ? &view->row : &view->col;
+        if (!read_index(ses, index))
+            range_status = 0;
+        else if (*index >= (kind == PATCH_ROW ? rows : cols))
+            range_status = -1;
+        if (kind == PATCH_ROW)
+            view->rows = 1;
+        else
+            view->cols = 1;
+    }
+    if (range_status == 0)
+        return view_error(ses, REPORT_ILLEGAL_RANGE, "illegal range", NULL);
+    if (range_status == -1)
+        return view_error(ses, REPORT_OUT_OF_BOUNDS, "range is out of the bounds of \"%.*s\"", mat_name);
+    if (peek_next_char(ses) == '\n')
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if (peek_next_char(ses) != ',')
+        return view_error(ses, REPORT_MISSING_COMMA, "missing comma", NULL);
+    read_char(ses);
+    *elements_count = view->rows * view->cols;
+    if ((*elements = calloc(*elements_count, sizeof(float))) == NULL){
+        report_error(ses, REPORT_FAILED, "%.*s", REPORT_MAX_QUOTE, mat_strerror(MAT_ERR_ALLOC));
+        skip_line(ses);
+        return 0;
+    }
+    return read_mat_elements(ses, *elements, *elements_count);
+}
+
+/*
+ * read_map_operand:
+ * reads the operand of an arithmetic operation of the "map" command,
+ * a matrix name, whose index is saved in "stage", or a number, saved as
+ * its scalar. returns the status like "read_map_parameters".
+ */
+int read_map_operand(session *ses, map_stage *stage, mat *matrices){
+    int c;
+    char mat_name[MAX_BUFFER_SIZE];
+    stage->operand = -1;
+    if ((c = peek_next_char(ses)) == '|' || c == '\n')
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if (is_legal_mat_char(c)){
+        read_next_mat_string(ses, mat_name);
+        if ((stage->operand = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+            return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    }
+    else if (!read_float(ses, &stage->scalar)){
+        report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\'", c);
+        skip_line(ses);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * read_map_parameters:
+ * reads the parameters of the "map" command, which has its own syntax:
+ * "map MAT_X = MAT_Y | op | op ...", the operations applied in turn to
+ * the elements of MAT_Y, in a single pass, are "add", "sub", "mul" and
+ * "div" followed by a matrix (of the shape of MAT_Y, or a row, a column
+ * or a single element, repeated over it) or a number, "exp", "relu",
+ * and "clamp" followed by the bounds "low, high". the output matrix is
+ * saved in mat_selection[2], the input in mat_selection[0] and the
+ * operations in "stages", at most MAX_MAP_STAGES of them. returns the
+ * status: 1 if everything is OK, 0 otherwise (the error is reported
+ * and the line is skipped).
+ */
+int read_map_parameters(session *ses, int *mat_selection, map_stage *stages, int *stages_count, mat *matrices){
+    static const char *names[] = {"add", "sub", "mul", "div", "exp", "relu", "clamp"};
+    int c, i, op;
+    float low;
+    char mat_name[MAX_BUFFER_SIZE], op_name[MAX_BUFFER_SIZE];
+    map_stage *stage;
+    *stages_count = 0;
+    if (read_next_mat_string(ses, mat_name) == '\n' && !strlen(mat_name))
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if ((mat_selection[2] = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+        return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    if (peek_next_char(ses) != '=')
+        return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"=\" following matrix name", NULL);
+    read_char(ses);
+    skip_whites(ses);
+    read_next_mat_string(ses, mat_name);
+    if ((mat_selection[0] = find_matrix(matrices, mat_name)) == MATRIX_COUNT)
+        return view_error(ses, REPORT_UNKNOWN_MATRIX, "unknown matrix \"%.*s\"", mat_name);
+    while((c = peek_next_char(ses)) != '\n'){
+        if (c != '|')
+            return view_error(ses, REPORT_MISSING_DELIMITER, "missing \"|\" between operations", NULL);
+        read_char(ses);
+        skip_whites(ses);
+        for(i = 0; islower((c = read_char(ses))); ){
+            if (i < MAX_BUFFER_SIZE - 1)
+                op_name[i++] = c;
+        }
+        op_name[i] = '\0';
+        unread_char(ses, c);
+        if (!i && (c == '|' || c == '\n'))
+            return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+        if (!i){
+            report_error(ses, REPORT_ILLEGAL_CHAR, "illegal char \'%c\'", c);
+            skip_line(ses);
+            return 0;
+        }
+        for(op = MAT_MAP_ADD; op <= MAT_MAP_CLAMP && strcmp(op_name, names[op]); op++)
+            ;
+        if (op > MAT_MAP_CLAMP)
+            return view_error(ses, REPORT_UNKNOWN_OPERATION, "unknown operation \"%.*s\"", op_name);
+        if (*stages_count == MAX_MAP_STAGES){
+            report_error(ses, REPORT_TOO_MANY_OPERATIONS, "more than %d operations", MAX_MAP_STAGES);
+            skip_line(ses);
+            return 0;
+        }
+        stage = &stages[(*stages_count)++];
+        stage->op = op;
+        stage->operand = -1;
+        stage->scalar = stage->limit = 0.0f;
+        if (op <= MAT_MAP_DIV && !read_map_operand(ses, stage, matrices))
+            return 0;
+        if (op == MAT_MAP_CLAMP){
+            if (!read_map_operand(ses, stage, matrices))
+                return 0;
+            low = stage->scalar;
+            if (stage->operand >= 0)
+                return view_error(ses, REPORT_ILLEGAL_RANGE, "illegal range", NULL);
+            if (peek_next_char(ses) != ',')
+                return view_error(ses, REPORT_MISSING_COMMA, "missing comma", NULL);
+            read_char(ses);
+            if (!read_map_operand(ses, stage, matrices))
+                return 0;
+            if (stage->operand >= 0 || low > stage->scalar)
+                return view_error(ses, REPORT_ILLEGAL_RANGE, "illegal range", NULL);
+            stage->limit = stage->scalar;
+            stage->scalar = low;
+        }
+    }
+    skip_line(ses);
+    return 1;
+}
+
+/*
+ * read_path_parameter:
+ * reads a file name, which is anything up to the next space, tab or line
+ * break, and saves it in "path", nothing may follow it. returns the
+ * status: 1 if everything is OK, 0 otherwise (the error is reported
+ * and the line is skipped).
+ */
+int read_path_parameter(session *ses, char *path){
+    int c, i = 0;
+    while(i < FILENAME_MAX - 1 && (c = read_char(ses)) != ' ' && c != '\t' && c != '\n')
+        path[i++] = c;
+    path[i] = '\0';
+    if (i < FILENAME_MAX - 1)
+        unread_char(ses, c);
+    if (!i)
+        return view_error(ses, REPORT_TOO_FEW_ARGUMENTS, "too few arguments", NULL);
+    if (peek_next_char(ses) != '\n')
+        return view_error(ses, REPORT_EXTRANEOUS_TEXT, "extraneous text at end of command", NULL);
+    skip_line(ses);
+    return 1;
 }
 
 /*
@@ -405,14 +997,14 @@ void stop(int *stop_flag){
  * checks if a command is followed by a comma character and stops
  * the line processing and skips to the next line.
  */
-int check_comma_error(void){
+int check_comma_error(session *ses){
     int c, status = 1;
-    skip_whites();
-    c = peek_next_char();
+    skip_whites(ses);
+    c = peek_next_char(ses);
     if (c == ','){
         status = 0;
-        skip_line();
-        printf("Error: invalid comma after command, skipping line\n");
+        report_error(ses, REPORT_INVALID_COMMA, "invalid comma after command, skipping line");
+        skip_line(ses);
     }
     return status;
 }
@@ -427,67 +1019,106 @@ int check_comma_error(void){
  * parameter to be read is the last (for error checking purposes). the function calls
  * are performed in the proper order. the function uses the meta data
  * from the function list to determine how many and what type of parameters
- * need to be processed.
+ * need to be processed. the matrix elements are read into a new array,
+ * saved in "elements" (freed by the caller), as many as the output
+ * matrix has, which is saved in "elements_count".
  */
-int read_parameters(int selection, int *mat_selection, float *scalar_input, float *elements, mat *matrices){
-    int status = check_comma_error();
+int read_parameters(session *ses, int selection, int *mat_selection, float *scalar_input, float **elements,
+                    int *elements_count, slice *view, char *path, map_stage *stages, int *stages_count,
+                    mat *matrices){
+    mat_t *output;
+    int status = check_comma_error(ses);
     int p_count = functions_list[selection].parameters_count;
     if (status){
         if (functions_list[selection].mat_input)
-            mat_selection[0] = read_mat_parameter(matrices, p_count--, &status);
+            mat_selection[0] = read_mat_parameter(ses, matrices, p_count--, &status);
         if (functions_list[selection].mat_input == 2 && status)
-            mat_selection[1] = read_mat_parameter(matrices, p_count--, &status);
+            mat_selection[1] = read_mat_parameter(ses, matrices, p_count--, &status);
         if (functions_list[selection].takes_scalar && status){
-            read_scalar_parameter(scalar_input, &status);
+            read_scalar_parameter(ses, scalar_input, &status);
             p_count--;
         }
-        if (functions_list[selection].has_output && status){
-            mat_selection[2] = read_mat_parameter(matrices, p_count--, &status);
+        if (functions_list[selection].mat_output && status){
+            mat_selection[2] = read_mat_parameter(ses, matrices, p_count--, &status);
+        }
+        if (functions_list[selection].mat_output == 2 && status)
+            mat_selection[3] = read_mat_parameter(ses, matrices, p_count--, &status);
+        if (functions_list[selection].reads_floats && status){
+            lock_matrix(mat_selection[2], LOCK_READ);
+            output = matrices[mat_selection[2]].data;
+            *elements_count = mat_rows(output) * mat_cols(output);
+            unlock_matrix(mat_selection[2]);
+            if ((*elements = calloc(*elements_count, sizeof(float))) == NULL){
+                report_error(ses, REPORT_FAILED, "%.*s", REPORT_MAX_QUOTE, mat_strerror(MAT_ERR_ALLOC));
+                skip_line(ses);
+                status = 0;
+            }
+            else
+                status = read_mat_elements(ses, *elements, *elements_count);
         }
-        if (functions_list[selection].reads_floats && status)
-            read_mat_elements(elements);
+        if (functions_list[selection].reads_view && status)
+            status = read_view_parameters(ses, mat_selection, view, matrices);
+        if (functions_list[selection].reads_path && status)
+            status = read_path_parameter(ses, path);
+        if (functions_list[selection].reads_patch && status)
+            status = read_patch_parameters(ses, functions_list[selection].reads_patch, mat_selection, view,
+                                           elements, elements_count, matrices);
+        if (functions_list[selection].reads_map && status)
+            status = read_map_parameters(ses, mat_selection, stages, stages_count, matrices);
     }
     return status;
 }
 
 /*
  * read_mat:
- * takes the mat selection as input, where it stores the floats from
- * the elements array supplied and saves them into the "matrix" that belongs
- * to the relevant "mat" selected by the user.
- */
-void read_mat(int mat_selected, float *elements, mat *matrices){
-    int i, j, k = 0;
-    matrix dest_mat = matrices[mat_selected].data;
-    for (i = 0; i < DEFAULT_SIZE; i++){
-        for (j = 0; j < DEFAULT_SIZE; j++){
-            dest_mat[i][j] = elements[k];
-            k++;
-        }
-    }
+ * takes the parameters structure, with the mat selection, and saves the
+ * floats from the elements array into the "matrix" that belongs
+ * to the relevant "mat" selected by the user, using the engine. another
+ * session may have changed the shape of the matrix since the elements
+ * were read, in which case nothing is saved.
+ */
+void read_mat(parameters *params){
+    mat_t *output = (params->matrices)[(params->mat_selection)[2]].data;
+    if (mat_rows(output) * mat_cols(output) != params->elements_count)
+        report_failure(params, mat_strerror(MAT_ERR_SHAPE));
+    else
+        mat_load(output, params->elements);
 }
 
 /*
  * call_function:
  * calls the selected function with the parameters structure, using
- * the pointer stored in the "functions_list" array.
+ * the pointer stored in the "functions_list" array, through the result
+ * cache for the functions whose results may be cached, then records
+ * how the output matrix was computed, so patches of the inputs can be
+ * carried over to it (see "patch.h").
  */
 void call_function(parameters *params, int *stop_flag){
+    const func *f = &functions_list[params->func_selection];
+    mat_t *output;
+    unsigned long id = 0, version = 0;
+    if (f->mat_output){
+        output = (params->matrices)[(params->mat_selection)[2]].data;
+        id = mat_id(output);
+        version = mat_version(output);
+    }
     switch(params->func_selection){
         case 0:
-            read_mat((params->mat_selection)[2], params->elements, params->matrices);
+            read_mat(params);
             break;
-        case 1:
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-            (functions_list[params->func_selection].func)(params, DEFAULT_SIZE);
-            break;
-        case 7:
+        case FUNCTIONS_COUNT - 1:
             stop(stop_flag);
             break;
+        default:
+            if (functions_list[params->func_selection].memoize)
+                memo_call(params, functions_list[params->func_selection].func,
+                          functions_list[params->func_selection].mat_input,
+                          functions_list[params->func_selection].takes_scalar);
+            else
+                (functions_list[params->func_selection].func)(params);
+            if (f->mat_output)
+                record_dependency(params, f->func, id, version);
+            break;
     }
 }
 
@@ -495,86 +1126,243 @@ void call_function(parameters *params, int *stop_flag){
  * pre_process_line:
  * stop flag is set 1 if an error is detected and the status is 1 when
  * everything is fine, 0 otherwise. this functions reads the whole line
- * up to the defined buffer size: if the the number of characters is less
+ * up to the defined buffer size into the line of the session: if the the number of characters is less
  * than the max and the line is terminated with a line break, then its printed
- * to stdout and is unread back to the buffer, so process line can perform
- * its work, other wise (in case buffer is maxed or EOF is detected),
+ * to the output of the session, and "process_line" parses it from there, other wise (in case buffer is maxed or EOF is detected),
  * it stops the program. the printing part and EOF detection is better
  * done here, otherwise, it could cause the code to be less readable
  * or more complicated, so I'd rather its done here.
  */
-int pre_process_line(int *stop_flag){
-    char line[MAX_LINE_SIZE];
-    int c, j, i = 0;
-    while(i < MAX_LINE_SIZE - 1 && (c = getc(stdin)) != '\n' && c != EOF)
-                line[i++] = c;
-    line[i++] = '\0';
-    puts(line);
-    if (c == '\n'){
-        ungetc('\n', stdin);
-        for(j = i - 2; 0 <= j; j--)
-            ungetc(line[j], stdin);
-    }
-    else {
+int pre_process_line(session *ses, int *stop_flag){
+    int c, i = 0;
+    while(i < MAX_LINE_SIZE - 1 && (c = getc(ses->in)) != '\n' && c != EOF)
+                ses->line[i++] = c;
+    ses->line[i] = '\0';
+    fprintf(ses->out, "%s\n", ses->line);
+    ses->line[i] = '\n';
+    ses->length = i + 1;
+    ses->column = 0;
+    if (c != '\n'){
         *stop_flag = 1;
+        ses->column = i;
         if (c == EOF)
-            puts("Error: End of File character detected, terminating...");
+            report_error(ses, REPORT_END_OF_FILE, "End of File character detected, terminating...");
         else
-            printf("Error: line should be up to %d chars, terminating...\n", MAX_LINE_SIZE);
+            report_error(ses, REPORT_LINE_TOO_LONG, "line should be up to %d chars, terminating...", MAX_LINE_SIZE);
     }
     return *stop_flag ? 0 : 1;
 }
 
+/*
+ * select_locks:
+ * fills "modes" (see "registry.h") with the locks the selected
+ * function needs on the matrices selected by the user: read locks
+ * on the inputs and write locks on the outputs.
+ */
+void select_locks(int selection, int *mat_selection, int *modes){
+    int i;
+    for(i = 0; i < MATRIX_COUNT; i++)
+        modes[i] = functions_list[selection].all_matrices;
+    for(i = 0; i < functions_list[selection].mat_input; i++)
+        modes[mat_selection[i]] = modes[mat_selection[i]] > LOCK_READ ? modes[mat_selection[i]] : LOCK_READ;
+    if (functions_list[selection].reads_view)
+        modes[mat_selection[0]] = LOCK_READ;
+    if (functions_list[selection].mat_output || functions_list[selection].reads_view
+        || functions_list[selection].reads_map)
+        modes[mat_selection[2]] = LOCK_WRITE;
+    if (functions_list[selection].mat_output == 2)
+        modes[mat_selection[3]] = LOCK_WRITE;
+}
+
 /*
  * process_line:
- * takes the matrices array, defines several data structures to hold
- * the reading functions output and allocates (later frees) the memory
- * needed for their operation, reads the command, if no errors,
+ * takes the matrices array and the number of the line, defines several
+ * data structures to hold the reading functions output and allocates
+ * (later frees) the memory needed for their operation, reads the command
+ * from the line of the session (see "pre_process_line"), if no errors,
  * calls "read_parameters" (which returns its status), if no errors,
  * calls the function "call_function", to call the selected function
- * using the read parameters as input.
+ * using the read parameters as input, holding the locks it needs
+ * meanwhile, since other sessions may use the matrices too. the whole
+ * line is read before any matrix is touched, so a command with errors
+ * changes nothing. blank lines are ignored. the parsing only depends on
+ * the line of the session, not on its input stream.
  */
-void process_line(mat *matrices, int *stop_flag){
-    float scalar_input, *elements;
-    int func_selection, mat_selection[3];
-    char command[MAX_BUFFER_SIZE];
+void process_line(session *ses, mat *matrices, long line_number, int *stop_flag){
+    float scalar_input, *elements = NULL;
+    int func_selection, mat_selection[4], elements_count = 0, stages_count = 0, modes[MATRIX_COUNT];
+    char command[MAX_BUFFER_SIZE], path[FILENAME_MAX];
+    slice view;
+    map_stage stages[MAX_MAP_STAGES];
     parameters params;
-    elements = calloc(DEFAULT_SIZE * DEFAULT_SIZE, sizeof(float));
-    read_command(command);
+    ses->line_number = line_number;
+    read_command(ses, command);
     func_selection = select_function(command);
-    if (func_selection >= FUNCTIONS_COUNT){
-         printf("Error: unknown command \"%s\"\n",command);
-         skip_line();
+    if (!strlen(command) && peek_next_char(ses) == '\n')
+        skip_line(ses);
+    else if (func_selection >= FUNCTIONS_COUNT){
+         report_error(ses, REPORT_UNKNOWN_COMMAND, "unknown command \"%.*s\"", REPORT_MAX_QUOTE, command);
+         skip_line(ses);
     }
-    else if (read_parameters(func_selection, mat_selection, &scalar_input, elements, matrices)){
-        params = pack_parameters(func_selection, scalar_input, elements, mat_selection, matrices);
+    else if (functions_list[func_selection].reads_path && !ses->files){
+        report_error(ses, REPORT_NOT_ALLOWED, "command \"%.*s\" is not allowed in this session", REPORT_MAX_QUOTE,
+                     command);
+        skip_line(ses);
+    }
+    else if (read_parameters(ses, func_selection, mat_selection, &scalar_input, &elements,
+                             &elements_count, &view, path, stages, &stages_count, matrices)){
+        params = pack_parameters(func_selection, scalar_input, elements, elements_count, mat_selection,
+                                 matrices, &view, path, stages, stages_count, line_number, ses->out, ses->errors);
+        select_locks(func_selection, mat_selection, modes);
+        lock_matrices(matrices, modes);
         call_function(&params ,stop_flag);
+        unlock_matrices(modes);
     }
     free(elements);
 }
 
+/*
+ * auto_checkpoint:
+ * saves the matrices to the checkpoint file of the "-c" option, if
+ * any, along with the number of lines processed so far.
+ */
+void auto_checkpoint(session *ses, options *opts, mat *matrices, long line_number){
+    checkpoint_status status;
+    if (opts->checkpoint_path == NULL)
+        return;
+    if ((status = checkpoint_save(opts->checkpoint_path, matrices, MATRIX_COUNT, line_number)) != CHECKPOINT_OK)
+        report_error(ses, REPORT_FAILED, "%.*s", REPORT_MAX_QUOTE, checkpoint_strerror(status));
+}
+
+/*
+ * resume:
+ * restores the matrices saved in the checkpoint file "path" and skips
+ * the input lines processed before it was saved, without echoing them,
+ * their number is saved in "line_number". returns 1 if everything is
+ * OK, otherwise the error is reported and 0 is returned.
+ */
+int resume(session *ses, char *path, mat *matrices, long *line_number){
+    long skipped = 0;
+    int c;
+    checkpoint_status status = checkpoint_load(path, matrices, MATRIX_COUNT, line_number);
+    if (status != CHECKPOINT_OK){
+        report_error(ses, REPORT_FAILED, "%.*s, terminating...", REPORT_MAX_QUOTE, checkpoint_strerror(status));
+        return 0;
+    }
+    while(skipped < *line_number && (c = getc(ses->in)) != EOF)
+        if (c == '\n')
+            skipped++;
+    if (skipped < *line_number){
+        report_error(ses, REPORT_END_OF_FILE, "input ends before line %ld of the checkpoint, terminating...", *line_number);
+        return 0;
+    }
+    fprintf(ses->out, "Resuming after line %ld\n", *line_number);
+    return 1;
+}
+
+/*
+ * run_session:
+ * processes each line of the session: ">>>" marks the beginning of a
+ * new line, each iteration the line is pre-processed, if everything
+ * goes well, the line is processed, and every so many lines the
+ * matrices are checkpointed, if the user asked for it. "line_number"
+ * is the number of lines already processed. when something is "wrong"
+ * detected by any function called down the way, the flag is set to 1,
+ * and the loop terminates, after a last checkpoint. the line of the
+ * session is a local buffer, so it's detached from the session then.
+ */
+void run_session(session *ses, mat *matrices, options *opts, long line_number){
+    int stop_flag = 0;
+    char line[MAX_LINE_SIZE];
+    ses->line = line;
+    while(!stop_flag){
+        fprintf(ses->out, ">>> ");
+        fflush(ses->out);
+        if (pre_process_line(ses, &stop_flag))
+            process_line(ses, matrices, ++line_number, &stop_flag);
+        if (stop_flag || line_number % opts->checkpoint_interval == 0)
+            auto_checkpoint(ses, opts, matrices, line_number);
+    }
+    ses->line = NULL;
+}
+
+/*
+ * serve_session:
+ * runs the session of a connection to the server, with the default
+ * options (see "default_options"), so without checkpoints.
+ */
+void serve_session(session *ses, mat *matrices){
+    options opts;
+    default_options(&opts);
+    run_session(ses, matrices, &opts, 0);
+}
+
+/*
+ * start_server:
+ * restores the matrices from the "-r" checkpoint, if any, and serves
+ * them until the program is killed, returns only if something fails,
+ * after reporting it to the session of the standard input and output.
+ */
+void start_server(session *ses, options *opts, mat *matrices){
+    long line_number;
+    checkpoint_status status;
+    if (opts->restore_path != NULL
+        && (status = checkpoint_load(opts->restore_path, matrices, MATRIX_COUNT, &line_number)) != CHECKPOINT_OK)
+        report_error(ses, REPORT_FAILED, "%.*s, terminating...", REPORT_MAX_QUOTE, checkpoint_strerror(status));
+    else if (!serve(opts->socket_path, opts->port, opts->errors, matrices, serve_session))
+        report_error(ses, REPORT_FAILED, "cannot listen for connections, terminating...");
+}
+
 /*
  * mat_calculator:
- * creates 6 matrices, places them in an array, initializes them,
- * then processes each line: ">>>" marks the beginning of a new line,
- * each iteration the line is pre-processed, if everything goes well,
- * the line is processed. when something is "wrong" detected by
- * any function called down the way, the flag is set to 1, and the loop
- * terminates, stopping the program, after freeing the allocated memory.
- */
-void mat_calculator(void){
-    int i, stop_flag = 0;
+ * creates 6 matrices, places them in an array and initializes them
+ * (if one cannot be created, the error is reported and it returns),
+ * starts the worker processes and the compute pool (if they cannot
+ * start, the user is warned and the calculator works without them),
+ * then either runs the server or a session on the standard input and
+ * output (after restoring the matrices, see "resume"). when the
+ * session is done, or if the server fails to start (once it's up, the
+ * server only ends with the program), it stops the pool and the
+ * workers and frees the allocated memory.
+ */
+void mat_calculator(options *opts){
+    int i;
+    long line_number = 0;
+    mat_status status;
+    session user;
     mat matrices[] = { {"MAT_A", NULL}, {"MAT_B", NULL}, {"MAT_C", NULL},
                         {"MAT_D", NULL}, {"MAT_E", NULL}, {"MAT_F", NULL}};
+    user.in = stdin;
+    user.out = stdout;
+    user.errors = opts->errors;
+    user.files = 1;
+    user.line = NULL;
+    user.length = user.column = 0;
+    user.line_number = 0;
+    mat_set_placement(opts->placement);
     for(i = 0; i < MATRIX_COUNT; i++){
-        matrices[i].data = create_matrix(DEFAULT_SIZE);
-    }
-    while(!stop_flag){
-        printf(">>> ");
-        if (pre_process_line(&stop_flag))
-            process_line(matrices, &stop_flag);
+        if ((matrices[i].data = mat_create(DEFAULT_SIZE, DEFAULT_SIZE)) == NULL){
+            report_error(&user, REPORT_FAILED, "%.*s, terminating...", REPORT_MAX_QUOTE,
+                         mat_strerror(MAT_ERR_ALLOC));
+            while(i-- > 0)
+                mat_free(matrices[i].data);
+            return;
+        }
     }
+    if ((status = mat_grid_start(opts->workers)) != MAT_OK)
+        report_warning(&user, REPORT_FAILED, "could not start the worker processes: %.*s", REPORT_MAX_QUOTE,
+                       mat_strerror(status));
+    mat_pool_pin(opts->pin_step);
+    if ((status = mat_pool_start(opts->threads)) != MAT_OK)
+        report_warning(&user, REPORT_FAILED, "could not start the compute pool: %.*s", REPORT_MAX_QUOTE,
+                       mat_strerror(status));
+    if (opts->socket_path != NULL || opts->port)
+        start_server(&user, opts, matrices);
+    else if (opts->restore_path == NULL || resume(&user, opts->restore_path, matrices, &line_number))
+        run_session(&user, matrices, opts, line_number);
+    mat_pool_stop();
+    mat_grid_stop();
     for(i = 0; i < MATRIX_COUNT; i++){
-        free_matrix(matrices[i].data, DEFAULT_SIZE);
+        mat_free(matrices[i].data);
     }
 }
@@ -35,8 +35,21 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
+	${OBJECTDIR}/checkpoint.o \
+	${OBJECTDIR}/libmat.o \
+	${OBJECTDIR}/libmat_grid.o \
+	${OBJECTDIR}/libmat_map.o \
+	${OBJECTDIR}/libmat_place.o \
+	${OBJECTDIR}/libmat_pool.o \
+	${OBJECTDIR}/libmat_reduce.o \
+	${OBJECTDIR}/libmat_solve.o \
 	${OBJECTDIR}/mat.o \
-	${OBJECTDIR}/mymat.o
+	${OBJECTDIR}/memo.o \
+	${OBJECTDIR}/mymat.o \
+	${OBJECTDIR}/patch.o \
+	${OBJECTDIR}/registry.o \
+	${OBJECTDIR}/report.o \
+	${OBJECTDIR}/server.o
 
 
 # C Compiler Flags
@@ -53,7 +66,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=
+LDLIBSOPTIONS=-lpthread -lm
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -63,16 +76,81 @@ ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/exericise-22.exe: ${OBJECTFILES}
 	${MKDIR} -p ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}
 	${LINK.c} -o ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/exericise-22 ${OBJECTFILES} ${LDLIBSOPTIONS}
 
+${OBJECTDIR}/checkpoint.o: checkpoint.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/checkpoint.o checkpoint.c
+
+${OBJECTDIR}/libmat.o: libmat.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat.o libmat.c
+
+${OBJECTDIR}/libmat_grid.o: libmat_grid.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_grid.o libmat_grid.c
+
+${OBJECTDIR}/libmat_map.o: libmat_map.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_map.o libmat_map.c
+
+${OBJECTDIR}/libmat_place.o: libmat_place.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_place.o libmat_place.c
+
+${OBJECTDIR}/libmat_pool.o: libmat_pool.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_pool.o libmat_pool.c
+
+${OBJECTDIR}/libmat_reduce.o: libmat_reduce.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_reduce.o libmat_reduce.c
+
+${OBJECTDIR}/libmat_solve.o: libmat_solve.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/libmat_solve.o libmat_solve.c
+
 ${OBJECTDIR}/mat.o: mat.c
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/mat.o mat.c
 
+${OBJECTDIR}/memo.o: memo.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/memo.o memo.c
+
 ${OBJECTDIR}/mymat.o: mymat.c
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/mymat.o mymat.c
 
+${OBJECTDIR}/patch.o: patch.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/patch.o patch.c
+
+${OBJECTDIR}/registry.o: registry.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/registry.o registry.c
+
+${OBJECTDIR}/report.o: report.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/report.o report.c
+
+${OBJECTDIR}/server.o: server.c
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -g -std=c89 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/server.o server.c
+
 # Subprojects
 .build-subprojects:
 
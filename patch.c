@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mat.h"
+#include "report.h"
+#include "patch.h"
+
+/*
+ * the operations whose results follow the patches of their inputs.
+ */
+#define DEP_NONE 0
+#define DEP_MUL 1
+#define DEP_ADD 2
+#define DEP_SUB 3
+#define DEP_SCALE 4
+#define DEP_TRANS 5
+
+/*
+ * dependency:
+ * how a matrix was computed: the operation, the number of its inputs
+ * and their indexes in the matrices array, the scalar of DEP_SCALE,
+ * and the ids and versions (see "mat_version") of the inputs and of the
+ * result (at index 2) as of the last time it was brought up to date.
+ * the dependency is "live" while all of them are unchanged, that is,
+ * until the result or an input is written other than by a patch.
+ */
+typedef struct dependency {
+    int op;
+    int inputs;
+    int input[2];
+    float scalar;
+    unsigned long ids[3];
+    unsigned long versions[3];
+} dependency;
+
+/*
+ * region:
+ * a block of a matrix, its first row, number of rows, first column and
+ * number of columns.
+ */
+typedef struct region {
+    int row, rows, col, cols;
+} region;
+
+/*
+ * the dependency of each matrix, by index (DEP_NONE if it has none),
+ * shared by the sessions of the server, hence "deps_lock". patches
+ * hold the write locks of all the matrices too.
+ */
+static dependency deps[MATRIX_COUNT];
+static pthread_mutex_t deps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * stamp:
+ * an auxiliary function
+ * saves in "dep" the ids and versions its inputs and its result (the
+ * matrix at "index") have now.
+ */
+static void stamp(dependency *dep, mat *matrices, int index){
+    int i;
+    for(i = 0; i < dep->inputs; i++){
+        dep->ids[i] = mat_id(matrices[dep->input[i]].data);
+        dep->versions[i] = mat_version(matrices[dep->input[i]].data);
+    }
+    dep->ids[2] = mat_id(matrices[index].data);
+    dep->versions[2] = mat_version(matrices[index].data);
+}
+
+/*
+ * is_live:
+ * an auxiliary function
+ * returns 1 if the dependency of the matrix at "index" still holds.
+ */
+static int is_live(mat *matrices, int index){
+    dependency now = deps[index];
+    int i;
+    if (now.op == DEP_NONE)
+        return 0;
+    stamp(&now, matrices, index);
+    for(i = 0; i < 3; i++){
+        if ((i < now.inputs || i == 2) &&
+                (now.ids[i] != deps[index].ids[i] || now.versions[i] != deps[index].versions[i]))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * dependency_op:
+ * an auxiliary function
+ * returns the operation of the command function "func", DEP_NONE for
+ * those that don't follow patches.
+ */
+static int dependency_op(void (*func)(parameters*)){
+    if (func == mul_matrix)
+        return DEP_MUL;
+    if (func == add_matrix)
+        return DEP_ADD;
+    if (func == sub_matrix)
+        return DEP_SUB;
+    if (func == mul_scalar)
+        return DEP_SCALE;
+    if (func == trans_matrix)
+        return DEP_TRANS;
+    return DEP_NONE;
+}
+
+/*
+ * record_dependency:
+ * called after "func" ran on "params", "id" and "version" are those of
+ * the output matrix before it ran. if the output was written, records
+ * how it was computed, so patches of its inputs are carried over to it,
+ * for the products, sums, differences, scalings and transpositions.
+ * results written over one of their inputs or into a view (whose
+ * storage other matrices share) are not recorded.
+ */
+void record_dependency(parameters *params, void (*func)(parameters*), unsigned long id, unsigned long version){
+    int output = (params->mat_selection)[2];
+    mat_t *result = (params->matrices)[output].data;
+    dependency *dep = &deps[output];
+    if (mat_id(result) == id && mat_version(result) == version)
+        return;
+    pthread_mutex_lock(&deps_lock);
+    dep->op = dependency_op(func);
+    dep->inputs = dep->op == DEP_SCALE || dep->op == DEP_TRANS ? 1 : 2;
+    dep->input[0] = (params->mat_selection)[0];
+    dep->input[1] = dep->inputs == 2 ? (params->mat_selection)[1] : dep->input[0];
+    dep->scalar = params->scalar_input;
+    if (dep->input[0] == output || dep->input[1] == output || mat_is_shared(result))
+        dep->op = DEP_NONE;
+    if (dep->op != DEP_NONE)
+        stamp(dep, params->matrices, output);
+    pthread_mutex_unlock(&deps_lock);
+}
+
+/*
+ * affected:
+ * an auxiliary function
+ * returns the region of the result of "dep" (the matrix "c") that a
+ * change to the region "in" of its input number "slot" affects.
+ */
+static region affected(dependency *dep, mat_t *c, int slot, region in){
+    region out = in;
+    if (dep->op == DEP_MUL && slot == 0){
+        out.col = 0;
+        out.cols = mat_cols(c);
+    }
+    else if (dep->op == DEP_MUL){
+        out.row = 0;
+        out.rows = mat_rows(c);
+    }
+    else if (dep->op == DEP_TRANS){
+        out.row = in.col;
+        out.rows = in.cols;
+        out.col = in.row;
+        out.cols = in.rows;
+    }
+    return out;
+}
+
+/*
+ * product_update:
+ * an auxiliary function
+ * brings the region "out" of the product c = a * b up to date after
+ * the region "in" of input number "slot" changed from "old". a change
+ * to whole rows of a (columns of b) recomputes those rows (columns) of
+ * c, anything narrower is added as a rank-k update: the change of a
+ * rows x k block of a, times the k rows of b it multiplies, or the
+ * k columns of a times the change of a k x cols block of b.
+ */
+static mat_status product_update(mat_t *c, mat_t *a, mat_t *b, int slot, region in, region out, const mat_t *old){
+    mat_t *target = mat_view(c, out.row, out.col, out.rows, out.cols), *changed = NULL, *delta = NULL, *other;
+    mat_status status = MAT_ERR_ALLOC;
+    int whole = slot == 0 ? in.cols == mat_cols(a) : in.rows == mat_rows(b);
+    if (whole)
+        changed = slot == 0 ? mat_view(a, in.row, 0, in.rows, in.cols) : mat_view(b, 0, in.col, in.rows, in.cols);
+    else if ((changed = mat_view(slot == 0 ? a : b, in.row, in.col, in.rows, in.cols)) != NULL &&
+                (delta = mat_dup(changed)) != NULL && mat_sub(delta, delta, old) != MAT_OK){
+        mat_free(delta);
+        delta = NULL;
+    }
+    if (whole)
+        other = slot == 0 ? b : a;
+    else
+        other = slot == 0 ? mat_view(b, in.col, 0, in.cols, mat_cols(b)) : mat_view(a, 0, in.row, mat_rows(a), in.rows);
+    if (target != NULL && changed != NULL && (whole || delta != NULL) && other != NULL){
+        if (whole)
+            status = slot == 0 ? mat_gemm(target, changed, other, 1.0f, 0.0f) : mat_gemm(target, other, changed, 1.0f, 0.0f);
+        else
+            status = slot == 0 ? mat_gemm(target, delta, other, 1.0f, 1.0f) : mat_gemm(target, other, delta, 1.0f, 1.0f);
+    }
+    if (!whole)
+        mat_free(other);
+    mat_free(delta);
+    mat_free(changed);
+    mat_free(target);
+    return status;
+}
+
+/*
+ * update:
+ * an auxiliary function
+ * brings the region "out" of the result of "dep" (the matrix at
+ * "index") up to date after the region "in" of its input number "slot"
+ * changed from "old". a negative "slot" recomputes the whole result.
+ */
+static mat_status update(dependency *dep, mat *matrices, int index, int slot, region in, region out, const mat_t *old){
+    mat_t *c = matrices[index].data, *a = matrices[dep->input[0]].data, *b = matrices[dep->input[1]].data;
+    mat_t *target, *a_block, *b_block;
+    mat_status status = MAT_ERR_ALLOC;
+    if (slot < 0){
+        switch(dep->op){
+            case DEP_MUL:
+                return mat_gemm(c, a, b, 1.0f, 0.0f);
+            case DEP_ADD:
+                return mat_add(c, a, b);
+            case DEP_SUB:
+                return mat_sub(c, a, b);
+            case DEP_SCALE:
+                return mat_scale(c, a, dep->scalar);
+            default:
+                return mat_trans(c, a);
+        }
+    }
+    if (dep->op == DEP_MUL)
+        return product_update(c, a, b, slot, in, out, old);
+    target = mat_view(c, out.row, out.col, out.rows, out.cols);
+    a_block = mat_view(a, in.row, in.col, in.rows, in.cols);
+    b_block = mat_view(b, in.row, in.col, in.rows, in.cols);
+    if (target != NULL && a_block != NULL && b_block != NULL){
+        switch(dep->op){
+            case DEP_ADD:
+                status = mat_add(target, a_block, b_block);
+                break;
+            case DEP_SUB:
+                status = mat_sub(target, a_block, b_block);
+                break;
+            case DEP_SCALE:
+                status = mat_scale(target, a_block, dep->scalar);
+                break;
+            default:
+                status = mat_trans(target, a_block);
+                break;
+        }
+    }
+    mat_free(b_block);
+    mat_free(a_block);
+    mat_free(target);
+    return status;
+}
+
+/*
+ * changed_inputs:
+ * an auxiliary function
+ * counts the inputs of the result at "index" that the patch changes
+ * ("changed" is indexed like the matrices), saving the number of the
+ * last one in "slot". an input that may share its storage with a
+ * changed matrix (views) counts twice, since then the change can't be
+ * followed region by region. "ready" is set to 0 if any of those
+ * matrices isn't "done" yet.
+ */
+static int changed_inputs(mat *matrices, int index, int *changed, int *done, int *slot, int *ready){
+    dependency *dep = &deps[index];
+    int i, j, count = 0;
+    *ready = 1;
+    for(j = 0; j < dep->inputs; j++){
+        for(i = 0; i < MATRIX_COUNT; i++){
+            if (!changed[i])
+                continue;
+            if (dep->input[j] == i){
+                count++;
+                *slot = j;
+            }
+            else if (mat_is_shared(matrices[i].data) && mat_is_shared(matrices[dep->input[j]].data))
+                count += 2;
+            else
+                continue;
+            if (!done[i])
+                *ready = 0;
+        }
+    }
+    return count;
+}
+
+/*
+ * propagate:
+ * an auxiliary function
+ * carries the change of the region "changed" of the matrix at "index",
+ * whose elements were "old" before, over to the live results that
+ * depend on it ("live" is indexed like the matrices), and from them on
+ * to their own dependents. a result is updated once all the changed
+ * matrices it reads are, and it is recomputed whole if it reads more
+ * than one of them (or one twice), since the partial updates assume
+ * the other input is unchanged. results left behind (which only a
+ * cycle could cause) stop following their inputs.
+ */
+static mat_status propagate(mat *matrices, int index, region changed, mat_t *old, int *live){
+    region regions[MATRIX_COUNT];
+    mat_t *saved[MATRIX_COUNT], *block;
+    mat_status status = MAT_OK;
+    int reached[MATRIX_COUNT], done[MATRIX_COUNT], i, slot, uses, ready, progress;
+    for(i = 0; i < MATRIX_COUNT; i++){
+        reached[i] = done[i] = i == index;
+        saved[i] = NULL;
+    }
+    regions[index] = changed;
+    saved[index] = old;
+    do {
+        for(i = progress = 0; i < MATRIX_COUNT; i++){
+            if (live[i] && !reached[i] && changed_inputs(matrices, i, reached, done, &slot, &ready))
+                reached[i] = progress = 1;
+        }
+    } while(progress);
+    do {
+        for(i = progress = 0; i < MATRIX_COUNT && status == MAT_OK; i++){
+            if (!reached[i] || done[i])
+                continue;
+            uses = changed_inputs(matrices, i, reached, done, &slot, &ready);
+            if (!ready)
+                continue;
+            if (uses > 1){
+                slot = -1;
+                regions[i].row = regions[i].col = 0;
+                regions[i].rows = mat_rows(matrices[i].data);
+                regions[i].cols = mat_cols(matrices[i].data);
+            }
+            else
+                regions[i] = affected(&deps[i], matrices[i].data, slot, regions[deps[i].input[slot]]);
+            block = mat_view(matrices[i].data, regions[i].row, regions[i].col, regions[i].rows, regions[i].cols);
+            saved[i] = block == NULL ? NULL : mat_dup(block);
+            mat_free(block);
+            if (saved[i] == NULL)
+                status = MAT_ERR_ALLOC;
+            else if (slot < 0)
+                status = update(&deps[i], matrices, i, slot, changed, regions[i], NULL);
+            else
+                status = update(&deps[i], matrices, i, slot, regions[deps[i].input[slot]], regions[i],
+                                saved[deps[i].input[slot]]);
+            done[i] = progress = 1;
+        }
+    } while(progress && status == MAT_OK);
+    for(i = 0; i < MATRIX_COUNT; i++){
+        if (reached[i] && !done[i]){
+            live[i] = 0;
+            deps[i].op = DEP_NONE;
+        }
+        if (i != index)
+            mat_free(saved[i]);
+    }
+    return status;
+}
+
+/*
+ * patch_matrix:
+ * writes the elements read by the command over the block of the input
+ * matrix described by the "view" parameter (a row, a column or a
+ * block, see "patch.h"), then brings the results computed from it (see
+ * "record_dependency") up to date, and the results computed from
+ * those, updating only the parts the patch affects where it can: a
+ * patched row of a factor changes one row of a product, a patched
+ * block of it adds a rank-k update. the patched matrix itself no
+ * longer follows its own inputs, and if it shares its storage with
+ * other matrices (views), neither do the results that share theirs,
+ * since the patch may have written them. the block is checked again, since
+ * another session of the server may have reshaped the matrix since the
+ * command was read. if the update fails half way, no result is followed
+ * any more, since the ones left behind are out of date.
+ */
+void patch_matrix(parameters *params){
+    slice *v = params->view;
+    int index = (params->mat_selection)[0], live[MATRIX_COUNT], i;
+    mat_t *target = (params->matrices)[index].data, *block, *old = NULL;
+    int shared = mat_is_shared(target);
+    mat_status status = MAT_ERR_ALLOC;
+    region changed;
+    if (v->row + v->rows > mat_rows(target) || v->col + v->cols > mat_cols(target)){
+        report_failure(params, mat_strerror(MAT_ERR_RANGE));
+        return;
+    }
+    changed.row = v->row;
+    changed.rows = v->rows;
+    changed.col = v->col;
+    changed.cols = v->cols;
+    pthread_mutex_lock(&deps_lock);
+    for(i = 0; i < MATRIX_COUNT; i++){
+        live[i] = i != index && is_live(params->matrices, i);
+        if (i == index || (live[i] && shared && mat_is_shared((params->matrices)[i].data))){
+            live[i] = 0;
+            deps[i].op = DEP_NONE;
+        }
+    }
+    if ((block = mat_view(target, v->row, v->col, v->rows, v->cols)) != NULL && (old = mat_dup(block)) != NULL){
+        mat_load(block, params->elements);
+        mat_free(block);
+        block = NULL;
+        status = propagate(params->matrices, index, changed, old, live);
+    }
+    mat_free(old);
+    mat_free(block);
+    for(i = 0; i < MATRIX_COUNT; i++){
+        if (status != MAT_OK)
+            deps[i].op = DEP_NONE;
+        else if (live[i])
+            stamp(&deps[i], params->matrices, i);
+    }
+    pthread_mutex_unlock(&deps_lock);
+    if (status != MAT_OK)
+        report_failure(params, mat_strerror(status));
+}
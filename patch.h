@@ -0,0 +1,17 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "mat.h"
+
+    /*
+     * the forms of the patch commands, as "reads_patch" of their entry
+     * in the functions list: a row, a column or a block of a matrix.
+     */
+#define PATCH_ROW 1
+#define PATCH_COL 2
+#define PATCH_BLOCK 3
+
+    void record_dependency(parameters*, void (*)(parameters*), unsigned long, unsigned long);
+    void patch_matrix(parameters*);
+
+#endif
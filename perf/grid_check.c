@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "libmat.h"
+
+/*
+ * grid_check: the check of the worker grid of libmat (see the
+ * "grid-check" target of the Makefile), with all the workers on this
+ * machine. the calculator can't reach the grid, its matrices are far
+ * below the size a product needs to be split, so the library is driven
+ * directly.
+ *
+ * every product is computed once without the grid, then with grids of
+ * 1 to MAX_WORKERS workers, and the results must be the same bit for
+ * bit: the workers add up the products in the same order as the local
+ * path. the shapes aren't square and their sides aren't multiples of
+ * the worker counts, the products scale c by beta, one takes a
+ * transposed view. last, a worker is killed before a product, which
+ * must still be right, computed locally after the grid stops.
+ */
+
+#define MAX_WORKERS 6
+
+/*
+ * product:
+ * the shape and the scalars of a product c = alpha * a * b + beta * c,
+ * a rows x depth and b depth x cols, a is taken transposed from a
+ * depth x rows matrix if "transposed" is set. every product is large
+ * enough for the grid.
+ */
+typedef struct product {
+    int rows, depth, cols;
+    float alpha, beta;
+    int transposed;
+} product;
+
+static const product products[] = {
+    {300, 257, 311, 1.0f, 0.0f, 0},
+    {257, 700, 129, 2.5f, 1.0f, 0},
+    {513, 64, 601, 1.0f, -0.5f, 0},
+    {211, 401, 223, -1.0f, 0.25f, 1}
+};
+
+#define PRODUCTS_COUNT (int)(sizeof(products) / sizeof(products[0]))
+
+/*
+ * random_matrix:
+ * an auxiliary function
+ * creates a rows x cols matrix of pseudo random values in [-1, 1].
+ */
+static mat_t *random_matrix(int rows, int cols){
+    mat_t *m = mat_create(rows, cols);
+    int i, j;
+    if (m == NULL){
+        fprintf(stderr, "grid-check: out of memory\n");
+        exit(2);
+    }
+    for(i = 0; i < rows; i++){
+        for(j = 0; j < cols; j++)
+            mat_set(m, i, j, (float)rand() / RAND_MAX * 2.0f - 1.0f);
+    }
+    return m;
+}
+
+/*
+ * run_product:
+ * an auxiliary function
+ * computes the product "p" on the operands made from the seed "seed"
+ * with the grid as it is, and saves c, stored by rows, in "out".
+ */
+static void run_product(const product *p, unsigned seed, float *out){
+    mat_t *a, *at, *b, *c;
+    srand(seed);
+    at = random_matrix(p->transposed ? p->depth : p->rows, p->transposed ? p->rows : p->depth);
+    a = p->transposed ? mat_slice(at, 0, 0, p->depth, p->rows, 1, 1, 1) : at;
+    b = random_matrix(p->depth, p->cols);
+    c = random_matrix(p->rows, p->cols);
+    if (a == NULL || mat_gemm(c, a, b, p->alpha, p->beta) != MAT_OK){
+        fprintf(stderr, "grid-check: mat_gemm failed\n");
+        exit(2);
+    }
+    mat_store(c, out);
+    if (a != at)
+        mat_free(a);
+    mat_free(at);
+    mat_free(b);
+    mat_free(c);
+}
+
+/*
+ * workers_of:
+ * an auxiliary function
+ * saves in "pids" the child processes of this one, the workers, found
+ * in /proc, and returns how many there are (at most "max").
+ */
+static int workers_of(pid_t *pids, int max){
+    DIR *proc = opendir("/proc");
+    struct dirent *entry;
+    char path[64];
+    FILE *stat;
+    int count = 0, pid, ppid;
+    if (proc == NULL)
+        return 0;
+    while(count < max && (entry = readdir(proc)) != NULL){
+        if ((pid = atoi(entry->d_name)) <= 0)
+            continue;
+        sprintf(path, "/proc/%d/stat", pid);
+        if ((stat = fopen(path, "r")) == NULL)
+            continue;
+        if (fscanf(stat, "%*d (%*[^)]) %*c %d", &ppid) == 1 && ppid == getpid())
+            pids[count++] = pid;
+        fclose(stat);
+    }
+    closedir(proc);
+    return count;
+}
+
+/*
+ * compare:
+ * an auxiliary function
+ * compares the n elements of "got" with those of "expected", prints
+ * the outcome of the check "name" and returns 1 if they're the same.
+ */
+static int compare(const char *name, const float *got, const float *expected, long n){
+    long i;
+    for(i = 0; i < n && !memcmp(&got[i], &expected[i], sizeof(float)); i++)
+        ;
+    if (i == n){
+        printf("%-48s ok\n", name);
+        return 1;
+    }
+    printf("%-48s FAILED, element %ld differs\n", name, i);
+    return 0;
+}
+
+int main(void){
+    float *expected[PRODUCTS_COUNT], *got;
+    char name[64];
+    pid_t pids[MAX_WORKERS];
+    int i, workers, failures = 0;
+    long size, largest = 0;
+    for(i = 0; i < PRODUCTS_COUNT; i++){
+        size = (long)products[i].rows * products[i].cols;
+        largest = size > largest ? size : largest;
+        if ((expected[i] = malloc(size * sizeof(float))) == NULL)
+            return 2;
+        run_product(&products[i], i + 1, expected[i]);
+    }
+    if ((got = malloc(largest * sizeof(float))) == NULL)
+        return 2;
+    for(workers = 1; workers <= MAX_WORKERS; workers++){
+        if (mat_grid_start(workers) != MAT_OK){
+            printf("grid-check: could not start %d workers\n", workers);
+            return 1;
+        }
+        for(i = 0; i < PRODUCTS_COUNT; i++){
+            run_product(&products[i], i + 1, got);
+            sprintf(name, "%d x %d x %d, beta %g%s, %d workers", products[i].rows, products[i].depth,
+                    products[i].cols, products[i].beta, products[i].transposed ? ", a^T" : "", workers);
+            failures += !compare(name, got, expected[i], (long)products[i].rows * products[i].cols);
+        }
+        mat_grid_stop();
+    }
+    if (mat_grid_start(4) != MAT_OK || workers_of(pids, MAX_WORKERS) != 4){
+        printf("grid-check: could not find the 4 workers in /proc\n");
+        return 1;
+    }
+    kill(pids[2], SIGKILL);
+    run_product(&products[0], 1, got);
+    failures += !compare("a worker killed, the product is still right", got, expected[0],
+                         (long)products[0].rows * products[0].cols);
+    if (workers_of(pids, MAX_WORKERS) != 0){
+        printf("%-48s FAILED\n", "a worker killed, the grid is stopped");
+        failures++;
+    }
+    else
+        printf("%-48s ok\n", "a worker killed, the grid is stopped");
+    mat_grid_stop();
+    for(i = 0; i < PRODUCTS_COUNT; i++)
+        free(expected[i]);
+    free(got);
+    if (failures)
+        printf("grid-check: %d checks FAILED\n", failures);
+    else
+        printf("grid-check: all checks passed\n");
+    return failures != 0;
+}
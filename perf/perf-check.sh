@@ -0,0 +1,222 @@
+#!/bin/sh
+#
+# perf-check.sh: the performance gate of the calculator (see the
+# "perf-check" target of the Makefile).
+#
+#     perf-check.sh calculator baseline.json [record]
+#
+# writes a fixed suite of scripted workloads, runs each of them through
+# the calculator PERF_RUNS times (5 by default) and keeps the fastest
+# run. the times are compared against the baseline: the check fails if
+# a workload got slower than its time in the baseline by more than its
+# tolerance (a fraction, 0.25 lets it be up to 25% slower). with
+# "record", the times are written to the baseline instead, with the
+# tolerance PERF_TOLERANCE (0.25 by default).
+#
+# the workloads are generated with a fixed pseudo random sequence, the
+# same on every machine, they are:
+#     parse     long "read_mat" lines and other commands full of numbers
+#     multiply  chains of products, sums and element-wise maps
+#     io        printing of matrices, checkpoints and restores
+# a workload which reports any error fails the check, since a calculator
+# which stops early would look fast. warnings (a compute pool which
+# could not start) are shown, the times are still checked.
+#
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 calculator baseline.json [record]" >&2
+    exit 2
+fi
+
+CALCULATOR=$1
+BASELINE=$2
+MODE=${3:-check}
+RUNS=${PERF_RUNS:-5}
+TOLERANCE=${PERF_TOLERANCE:-0.25}
+WORKLOADS="parse multiply io"
+
+case $CALCULATOR in
+    /*) ;;
+    *) CALCULATOR=`pwd`/$CALCULATOR ;;
+esac
+if [ ! -x "$CALCULATOR" ]; then
+    echo "perf-check: $CALCULATOR is not an executable" >&2
+    exit 2
+fi
+if [ "$MODE" != record ] && [ ! -f "$BASELINE" ]; then
+    echo "perf-check: no baseline $BASELINE, record one with \"make perf-baseline\"" >&2
+    exit 2
+fi
+case `date +%s%N` in
+    *[!0-9]*)
+        echo "perf-check: \"date\" doesn't tell nanoseconds" >&2
+        exit 2 ;;
+esac
+
+WORKDIR=`mktemp -d "${TMPDIR:-/tmp}/perf-check.XXXXXX"` || exit 2
+trap 'rm -rf "$WORKDIR"' 0
+trap 'exit 2' 1 2 15
+
+#
+# generate: writes the workload $1 to the standard output. the numbers
+# come from the Park-Miller generator, exact in the doubles of any awk,
+# so every machine runs the same lines.
+#
+generate(){
+    awk -v workload="$1" '
+    function next_int(n){
+        seed = (seed * 16807) % 2147483647
+        return seed % n
+    }
+    function number(){
+        return sprintf("%.4f", (next_int(2000001) - 1000000) / 10000)
+    }
+    function elements(n,    i, s){
+        s = number()
+        for(i = 1; i < n; i++)
+            s = s ", " number()
+        return s
+    }
+    BEGIN {
+        seed = 20240607
+        quote = "\047"
+        split("MAT_A MAT_B MAT_C MAT_D MAT_E MAT_F", names, " ")
+        if (workload == "parse"){
+            for(i = 0; i < 40000; i++){
+                m = names[next_int(4) + 1]
+                print "read_mat " m ", " elements(16)
+                print "set_row " m ", " next_int(4) ", " elements(4)
+                print "set_block " m "[1:3, 0:2], " elements(4)
+                print "mul_scalar " m ", " number() ", MAT_F"
+                print "view MAT_E = " m "[0:4:2, 1:4]" quote
+                print "unview MAT_E"
+            }
+        }
+        else if (workload == "multiply"){
+            print "read_mat MAT_A, " elements(16)
+            print "read_mat MAT_B, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0"
+            print "read_mat MAT_D, " elements(16)
+            print "sum_cols_mat MAT_D, MAT_E"
+            for(i = 0; i < 40000; i++){
+                print "mul_mat MAT_A, MAT_B, MAT_C"
+                print "mul_mat MAT_C, MAT_B, MAT_A"
+                print "add_mat MAT_A, MAT_D, MAT_C"
+                print "sub_mat MAT_C, MAT_D, MAT_A"
+                print "trans_mat MAT_A, MAT_F"
+                print "mul_mat MAT_F, MAT_D, MAT_C"
+                print "mul_elem MAT_C, MAT_E, MAT_F"
+                print "map MAT_F = MAT_F | mul 0.001 | add MAT_E | exp | clamp -5, 5"
+            }
+        }
+        else if (workload == "io"){
+            for(i = 0; i < 4; i++)
+                print "read_mat " names[i + 1] ", " elements(16)
+            for(i = 0; i < 20000; i++){
+                print "print_mat " names[next_int(6) + 1]
+                print "print_mat MAT_A"
+                print "det_mat MAT_B"
+                print "minmax_mat MAT_C"
+                if (i % 20 == 0){
+                    print "checkpoint perf.ckpt"
+                    print "restore perf.ckpt"
+                }
+            }
+        }
+        print "stop"
+    }'
+}
+
+#
+# run: runs the workload file $1 through the calculator, RUNS times,
+# prints the time of the fastest run in seconds, fails if the
+# calculator reported an error.
+#
+run(){
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=`date +%s%N`
+        (cd "$WORKDIR" && "$CALCULATOR" < "$1" > "$1.out" 2>&1) || return 1
+        stop=`date +%s%N`
+        if grep -q '^Error' "$1.out"; then
+            grep '^Error' "$1.out" | head -3 >&2
+            return 1
+        fi
+        [ $i -eq 0 ] && grep '^Warning' "$1.out" | head -3 >&2
+        time=`expr $stop - $start`
+        if [ -z "$best" ] || [ "$time" -lt "$best" ]; then
+            best=$time
+        fi
+        i=`expr $i + 1`
+    done
+    awk -v ns="$best" 'BEGIN { printf("%.4f\n", ns / 1e9) }'
+}
+
+#
+# baseline_of: prints the time and the tolerance of the workload $1 in
+# the baseline, which has one workload per line, as written by "record".
+#
+baseline_of(){
+    awk -v name="$1" '
+    index($0, "\"" name "\":") {
+        sub(/.*"seconds": */, "", $0)
+        seconds = $0 + 0
+        sub(/.*"tolerance": */, "", $0)
+        print seconds, $0 + 0
+        found = 1
+    }
+    END { if (!found) print "" }' "$BASELINE"
+}
+
+status=0
+results=
+for w in $WORKLOADS; do
+    generate $w > "$WORKDIR/$w.txt"
+    if ! time=`run "$WORKDIR/$w.txt"`; then
+        echo "perf-check: workload \"$w\" failed" >&2
+        exit 1
+    fi
+    results="$results $w=$time"
+    if [ "$MODE" = record ]; then
+        printf "%-10s %8ss\n" $w $time
+        continue
+    fi
+    set -- `baseline_of $w`
+    if [ $# -lt 2 ]; then
+        echo "perf-check: workload \"$w\" is not in $BASELINE" >&2
+        status=1
+        continue
+    fi
+    if awk -v t="$time" -v b="$1" -v tol="$2" 'BEGIN { exit !(t > b * (1 + tol)) }'; then
+        verdict=REGRESSION
+        status=1
+    else
+        verdict=ok
+    fi
+    awk -v w="$w" -v t="$time" -v b="$1" -v tol="$2" -v v="$verdict" 'BEGIN {
+        printf("%-10s %8.4fs  baseline %8.4fs  %+6.1f%%  (limit %+.0f%%)  %s\n",
+               w, t, b, (t / b - 1) * 100, tol * 100, v)
+    }'
+done
+
+if [ "$MODE" = record ]; then
+    {
+        echo "{"
+        echo "    \"machine\": \"`uname -sm`\","
+        echo "    \"runs\": $RUNS,"
+        echo "    \"workloads\": {"
+        n=0
+        for r in $results; do
+            n=`expr $n + 1`
+            sep=,
+            [ $n -eq `echo $WORKLOADS | wc -w` ] && sep=
+            echo "        \"${r%%=*}\": {\"seconds\": ${r#*=}, \"tolerance\": $TOLERANCE}$sep"
+        done
+        echo "    }"
+        echo "}"
+    } > "$BASELINE"
+    echo "perf-check: baseline written to $BASELINE"
+elif [ $status -ne 0 ]; then
+    echo "perf-check: FAILED, a workload is slower than the baseline allows" >&2
+fi
+exit $status
@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "libmat.h"
+
+/*
+ * place_check: the check of the placement of large matrices and of the
+ * compute pool of libmat (see the "place-check" target of the
+ * Makefile), which the "-m", "-b" and "-t" options of the calculator
+ * set. the calculator can't reach them, its matrices are far below the
+ * sizes that are placed or split among the pool threads, so the
+ * library is driven directly.
+ *
+ * a set of operations runs on matrices large enough to be placed and
+ * split, once with the local placement and no pool, then with every
+ * placement, with and without a pool, pinned or not. the new matrices
+ * must be zeroed and every result the same bit for bit (the sum, which
+ * the pool adds up in another order, within a relative 1e-5). where
+ * /proc tells, the check also requires that interleaved matrices have
+ * the interleave memory policy and that the pinned pool threads run on
+ * the CPUs they were given.
+ */
+
+#define SIDE 730
+#define POOL_THREADS 3
+#define RESULTS_COUNT 5
+
+/*
+ * setup:
+ * a placement with the number of pool threads and the pinning step.
+ */
+typedef struct setup {
+    mat_placement placement;
+    int threads, pin_step;
+} setup;
+
+static const setup setups[] = {
+    {MAT_PLACE_LOCAL, POOL_THREADS, 0},
+    {MAT_PLACE_PARTITION, 0, 0},
+    {MAT_PLACE_PARTITION, POOL_THREADS, 0},
+    {MAT_PLACE_PARTITION, POOL_THREADS, 1},
+    {MAT_PLACE_PARTITION, POOL_THREADS, 2},
+    {MAT_PLACE_INTERLEAVE, 0, 0},
+    {MAT_PLACE_INTERLEAVE, POOL_THREADS, 2}
+};
+
+static const char *placement_names[] = {"local", "partition", "interleave"};
+
+#define SETUPS_COUNT (int)(sizeof(setups) / sizeof(setups[0]))
+
+/*
+ * results:
+ * the results of the operations of "run_operations", stored by rows.
+ */
+typedef struct results {
+    float *matrices[RESULTS_COUNT];
+    float sum;
+} results;
+
+/*
+ * create:
+ * an auxiliary function
+ * creates a rows x cols matrix, exits if it can't.
+ */
+static mat_t *create(int rows, int cols){
+    mat_t *m = mat_create(rows, cols);
+    if (m == NULL){
+        fprintf(stderr, "place-check: out of memory\n");
+        exit(2);
+    }
+    return m;
+}
+
+/*
+ * is_zero:
+ * an auxiliary function
+ * returns 1 if every element of "m" is 0.
+ */
+static int is_zero(const mat_t *m){
+    int i, j;
+    for(i = 0; i < mat_rows(m); i++){
+        for(j = 0; j < mat_cols(m); j++){
+            if (mat_get(m, i, j) != 0.0f)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * save:
+ * an auxiliary function
+ * stores "m" by rows in a new array.
+ */
+static float *save(const mat_t *m){
+    float *values = malloc((size_t)mat_rows(m) * mat_cols(m) * sizeof(float));
+    if (values == NULL){
+        fprintf(stderr, "place-check: out of memory\n");
+        exit(2);
+    }
+    mat_store(m, values);
+    return values;
+}
+
+/*
+ * run_operations:
+ * an auxiliary function
+ * creates the operands, with the placement and the pool as they are,
+ * runs the operations on them and saves their results in "out".
+ * returns 0 if a new matrix wasn't zeroed or an operation failed.
+ */
+static int run_operations(results *out){
+    mat_t *a = create(SIDE, SIDE), *b = create(SIDE, SIDE), *c = create(SIDE, SIDE);
+    mat_t *t = create(SIDE, SIDE), *sums = create(SIDE, 1), *bt;
+    mat_map_step steps[2];
+    int i, j, ok = is_zero(a) && is_zero(b) && is_zero(c);
+    srand(1);
+    for(i = 0; i < SIDE; i++){
+        for(j = 0; j < SIDE; j++){
+            mat_set(a, i, j, (float)rand() / RAND_MAX * 2.0f - 1.0f);
+            mat_set(b, i, j, (float)rand() / RAND_MAX * 2.0f - 1.0f);
+        }
+    }
+    steps[0].op = MAT_MAP_MUL;
+    steps[0].operand = NULL;
+    steps[0].scalar = 0.5f;
+    steps[1].op = MAT_MAP_EXP;
+    steps[1].operand = NULL;
+    steps[1].scalar = steps[0].limit = steps[1].limit = 0.0f;
+    bt = mat_slice(b, 0, 0, SIDE, SIDE, 1, 1, 1);
+    ok = ok && bt != NULL && mat_gemm(c, a, bt, 1.0f, 0.0f) == MAT_OK;
+    out->matrices[0] = save(c);
+    ok = ok && mat_add(c, a, b) == MAT_OK;
+    out->matrices[1] = save(c);
+    ok = ok && mat_map(c, a, steps, 2) == MAT_OK;
+    out->matrices[2] = save(c);
+    ok = ok && mat_trans(t, a) == MAT_OK;
+    out->matrices[3] = save(t);
+    ok = ok && mat_row_sums(sums, b) == MAT_OK;
+    out->matrices[4] = save(sums);
+    ok = ok && mat_sum(a, &out->sum) == MAT_OK;
+    mat_free(a);
+    mat_free(b);
+    mat_free(bt);
+    mat_free(c);
+    mat_free(t);
+    mat_free(sums);
+    return ok;
+}
+
+/*
+ * same_results:
+ * an auxiliary function
+ * returns 1 if "got" matches "expected", see the top of the file.
+ */
+static int same_results(const results *got, const results *expected){
+    static const long sizes[RESULTS_COUNT] = {(long)SIDE * SIDE, (long)SIDE * SIDE, (long)SIDE * SIDE,
+                                              (long)SIDE * SIDE, SIDE};
+    int k;
+    for(k = 0; k < RESULTS_COUNT; k++){
+        if (memcmp(got->matrices[k], expected->matrices[k], sizes[k] * sizeof(float)))
+            return 0;
+    }
+    return fabs(got->sum - expected->sum) <= 1e-5 * fabs(expected->sum);
+}
+
+/*
+ * free_results:
+ * an auxiliary function
+ * frees the arrays of "r".
+ */
+static void free_results(results *r){
+    int k;
+    for(k = 0; k < RESULTS_COUNT; k++)
+        free(r->matrices[k]);
+}
+
+/*
+ * interleaved_mappings:
+ * an auxiliary function
+ * returns how many mappings of this process have the interleave memory
+ * policy, -1 if /proc doesn't tell.
+ */
+static int interleaved_mappings(void){
+    FILE *maps = fopen("/proc/self/numa_maps", "r");
+    char line[512];
+    int count = 0;
+    if (maps == NULL)
+        return -1;
+    while(fgets(line, sizeof(line), maps) != NULL){
+        if (strstr(line, " interleave") != NULL)
+            count++;
+    }
+    fclose(maps);
+    return count;
+}
+
+/*
+ * check_interleave:
+ * an auxiliary function
+ * creates a large matrix with the interleave placement, returns 1 if a
+ * mapping with the interleave policy appeared, 0 if not, -1 if /proc
+ * doesn't tell.
+ */
+static int check_interleave(void){
+    int before = interleaved_mappings(), after;
+    mat_t *m;
+    if (before < 0)
+        return -1;
+    m = mat_create_placed(SIDE, SIDE, MAT_PLACE_INTERLEAVE);
+    after = interleaved_mappings();
+    mat_free(m);
+    return m != NULL && after > before;
+}
+
+/*
+ * check_pinning:
+ * an auxiliary function
+ * returns 1 if, for every pool thread i (from 1) of "threads", a thread
+ * of this process may only run on CPU i * step (wrapping around the
+ * online CPUs), 0 if not, -1 if /proc doesn't tell.
+ */
+static int check_pinning(int threads, int step){
+    int cpus[64], count = 0, i, k, found;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    char path[64], line[256], *end;
+    struct dirent *entry;
+    DIR *tasks = opendir("/proc/self/task");
+    FILE *status;
+    if (tasks == NULL || online <= 0){
+        if (tasks != NULL)
+            closedir(tasks);
+        return -1;
+    }
+    while(count < 64 && (entry = readdir(tasks)) != NULL){
+        if (atoi(entry->d_name) <= 0)
+            continue;
+        sprintf(path, "/proc/self/task/%d/status", atoi(entry->d_name));
+        if ((status = fopen(path, "r")) == NULL)
+            continue;
+        while(fgets(line, sizeof(line), status) != NULL){
+            if (!strncmp(line, "Cpus_allowed_list:", 18)){
+                cpus[count] = (int)strtol(line + 18, &end, 10);
+                if (*end == '\n')
+                    count++;
+            }
+        }
+        fclose(status);
+    }
+    closedir(tasks);
+    for(i = 1; i <= threads; i++){
+        for(found = 0, k = 0; k < count && !found; k++){
+            if (cpus[k] == (int)((long)i * step % online)){
+                cpus[k] = -1;
+                found = 1;
+            }
+        }
+        if (!found)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * report:
+ * an auxiliary function
+ * prints the outcome of the check "name" (1 ok, 0 failed, -1 not
+ * possible here) and returns 1 if it failed.
+ */
+static int report(const char *name, int outcome){
+    printf("%-56s %s\n", name, outcome > 0 ? "ok" : outcome < 0 ? "skipped" : "FAILED");
+    return outcome == 0;
+}
+
+int main(void){
+    results expected, got;
+    char name[96];
+    const setup *s;
+    int i, failures = 0;
+    if (!run_operations(&expected)){
+        printf("place-check: the operations failed without placement and pool\n");
+        return 1;
+    }
+    for(i = 0; i < SETUPS_COUNT; i++){
+        s = &setups[i];
+        mat_set_placement(s->placement);
+        mat_pool_pin(s->pin_step);
+        if (mat_pool_start(s->threads) != MAT_OK){
+            printf("place-check: could not start %d pool threads\n", s->threads);
+            return 1;
+        }
+        sprintf(name, "%s, %d pool threads, pinning step %d", placement_names[s->placement], s->threads,
+                s->pin_step);
+        failures += report(name, run_operations(&got) && same_results(&got, &expected));
+        free_results(&got);
+        if (s->pin_step > 0){
+            sprintf(name, "    pool threads pinned to CPUs i * %d", s->pin_step);
+            failures += report(name, check_pinning(s->threads, s->pin_step));
+        }
+        mat_pool_stop();
+    }
+    mat_set_placement(MAT_PLACE_LOCAL);
+    failures += report("interleaved matrices have the interleave policy", check_interleave());
+    free_results(&expected);
+    if (failures)
+        printf("place-check: %d checks FAILED\n", failures);
+    else
+        printf("place-check: all checks passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include "mat.h"
+#include "registry.h"
+
+/*
+ * the reader/writer locks of the matrices, by index, created on first
+ * use.
+ */
+static pthread_rwlock_t locks[MATRIX_COUNT];
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+
+/*
+ * init_locks:
+ * an auxiliary function
+ * creates the locks, run once.
+ */
+static void init_locks(void){
+    int i;
+    for(i = 0; i < MATRIX_COUNT; i++)
+        pthread_rwlock_init(&locks[i], NULL);
+}
+
+/*
+ * lock_matrix:
+ * locks the matrix at "index" in "mode", which is LOCK_READ or
+ * LOCK_WRITE. enough to look at the handle of the matrix (its shape),
+ * but not at its elements, which may be shared with other matrices,
+ * see "lock_matrices".
+ */
+void lock_matrix(int index, int mode){
+    pthread_once(&locks_once, init_locks);
+    if (mode == LOCK_WRITE)
+        pthread_rwlock_wrlock(&locks[index]);
+    else
+        pthread_rwlock_rdlock(&locks[index]);
+}
+
+void unlock_matrix(int index){
+    pthread_rwlock_unlock(&locks[index]);
+}
+
+/*
+ * shared_mode:
+ * an auxiliary function
+ * returns the strongest mode held on a matrix whose storage is shared
+ * with other matrices (views), LOCK_NONE if there is no such matrix.
+ */
+static int shared_mode(mat *matrices, int *modes){
+    int i, mode = LOCK_NONE;
+    for(i = 0; i < MATRIX_COUNT; i++){
+        if (modes[i] > mode && mat_is_shared(matrices[i].data))
+            mode = modes[i];
+    }
+    return mode;
+}
+
+/*
+ * lock_matrices:
+ * locks every matrix in its mode in "modes", in index order, so two
+ * commands never wait for each other. a view shares the elements of
+ * other matrices, which their own locks don't cover, so if any of
+ * the locked matrices is shared, all of the matrices are locked at
+ * least as strongly as the shared ones (views are rare enough), which
+ * is checked again once they are locked, since views may have been
+ * made in between. "modes" is updated to the locks actually held.
+ */
+void lock_matrices(mat *matrices, int *modes){
+    int i, mode, held;
+    while(1){
+        for(i = 0; i < MATRIX_COUNT; i++){
+            if (modes[i] != LOCK_NONE)
+                lock_matrix(i, modes[i]);
+        }
+        mode = shared_mode(matrices, modes);
+        for(i = 0, held = 1; i < MATRIX_COUNT; i++){
+            if (modes[i] < mode)
+                held = 0;
+        }
+        if (held)
+            return;
+        unlock_matrices(modes);
+        for(i = 0; i < MATRIX_COUNT; i++){
+            if (modes[i] < mode)
+                modes[i] = mode;
+        }
+    }
+}
+
+/*
+ * unlock_matrices:
+ * releases the locks taken by "lock_matrices".
+ */
+void unlock_matrices(int *modes){
+    int i;
+    for(i = 0; i < MATRIX_COUNT; i++){
+        if (modes[i] != LOCK_NONE)
+            unlock_matrix(i);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "mat.h"
+
+    /*
+     * the locks of the matrices array, shared by the sessions of the
+     * server: every matrix has a reader/writer lock, a command holds
+     * the locks of the matrices it reads (LOCK_READ) or writes
+     * (LOCK_WRITE) while it runs, "modes" arrays hold the mode of each
+     * of the MATRIX_COUNT matrices.
+     */
+#define LOCK_NONE 0
+#define LOCK_READ 1
+#define LOCK_WRITE 2
+
+    void lock_matrix(int, int);
+    void unlock_matrix(int);
+    void lock_matrices(mat*, int*);
+    void unlock_matrices(int*);
+
+#endif
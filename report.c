@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "mat.h"
+#include "report.h"
+
+/*
+ * the longest message, and of a format: a format quotes at most one
+ * string of REPORT_MAX_QUOTE chars and prints at most two numbers (of
+ * at most 20 chars each), so whatever it prints fits in the message.
+ */
+#define MAX_MESSAGE_SIZE 512
+#define MAX_FORMAT_SIZE (MAX_MESSAGE_SIZE - REPORT_MAX_QUOTE - 2 * 20 - 1)
+
+/*
+ * code_names:
+ * the names of the codes of "report_code", in the same order.
+ */
+static const char *code_names[] = {"unknown_command", "invalid_comma", "too_few_arguments", "extraneous_text",
+                                   "missing_comma", "consecutive_commas", "illegal_char", "unknown_matrix",
+                                   "illegal_name", "missing_delimiter", "illegal_range", "out_of_bounds",
+                                   "too_few_elements", "unknown_operation", "too_many_operations",
+                                   "line_too_long", "end_of_file", "not_allowed", "failed"};
+
+/*
+ * emit:
+ * an auxiliary function
+ * writes an error (or a warning if "warning" is 1) to "out" in the
+ * format "format" (see "report.h"). in JSON the message is escaped, it
+ * may quote any char of the input.
+ */
+static void emit(FILE *out, int format, int warning, report_code code, long line, int column, const char *message){
+    const unsigned char *p;
+    if (format != REPORT_JSON){
+        fprintf(out, "%s: %s\n", warning ? "Warning" : "Error", message);
+        return;
+    }
+    fprintf(out, "{\"level\": \"%s\", \"code\": \"%s\", \"line\": %ld, \"column\": %d, \"message\": \"",
+            warning ? "warning" : "error", code_names[code], line, column);
+    for(p = (const unsigned char *)message; *p; p++){
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x7f)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputs("\"}\n", out);
+}
+
+/*
+ * format_message:
+ * an auxiliary function
+ * formats the message of "report_error" or "report_warning" into
+ * "message", of MAX_MESSAGE_SIZE chars. a format too long for the bound
+ * above is not expanded, it's cut and taken as the message itself.
+ */
+static void format_message(char *message, const char *format, va_list args){
+    if (strlen(format) > MAX_FORMAT_SIZE)
+        sprintf(message, "%.*s", MAX_FORMAT_SIZE, format);
+    else
+        vsprintf(message, format, args);
+}
+
+/*
+ * report_error:
+ * reports an error found while reading the line of the session, at the
+ * position the parser reached (column 0 if no line is being read),
+ * "format" and the rest of the arguments are those of "printf".
+ */
+void report_error(session *ses, report_code code, const char *format, ...){
+    char message[MAX_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    format_message(message, format, args);
+    va_end(args);
+    emit(ses->out, ses->errors, 0, code, ses->line_number, ses->line != NULL ? ses->column + 1 : 0, message);
+}
+
+/*
+ * report_warning:
+ * works like "report_error", for problems the command goes on despite.
+ */
+void report_warning(session *ses, report_code code, const char *format, ...){
+    char message[MAX_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    format_message(message, format, args);
+    va_end(args);
+    emit(ses->out, ses->errors, 1, code, ses->line_number, ses->line != NULL ? ses->column + 1 : 0, message);
+}
+
+/*
+ * report_failure:
+ * reports that the command of the line "params" were read from failed,
+ * "message" says why.
+ */
+void report_failure(parameters *params, const char *message){
+    emit(params->out, params->errors, 0, REPORT_FAILED, params->line_number, 0, message);
+}
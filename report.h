@@ -0,0 +1,54 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "mat.h"
+
+    /*
+     * the formats of the errors and warnings, as "errors" of the session:
+     * "Error: message" lines, or one JSON object per line, with the
+     * level, code, line, column (0 when it isn't tied to a position in
+     * the line) and message.
+     */
+#define REPORT_TEXT 0
+#define REPORT_JSON 1
+
+    /*
+     * report_code:
+     * what went wrong, the "code" of the JSON format.
+     */
+    typedef enum report_code {
+        REPORT_UNKNOWN_COMMAND,
+        REPORT_INVALID_COMMA,
+        REPORT_TOO_FEW_ARGUMENTS,
+        REPORT_EXTRANEOUS_TEXT,
+        REPORT_MISSING_COMMA,
+        REPORT_CONSECUTIVE_COMMAS,
+        REPORT_ILLEGAL_CHAR,
+        REPORT_UNKNOWN_MATRIX,
+        REPORT_ILLEGAL_NAME,
+        REPORT_MISSING_DELIMITER,
+        REPORT_ILLEGAL_RANGE,
+        REPORT_OUT_OF_BOUNDS,
+        REPORT_TOO_FEW_ELEMENTS,
+        REPORT_UNKNOWN_OPERATION,
+        REPORT_TOO_MANY_OPERATIONS,
+        REPORT_LINE_TOO_LONG,
+        REPORT_END_OF_FILE,
+        REPORT_NOT_ALLOWED,
+        REPORT_FAILED
+    } report_code;
+
+    /*
+     * REPORT_MAX_QUOTE:
+     * the most chars of a string a message quotes: the formats of
+     * "report_error" and "report_warning" take their strings (names,
+     * commands, error strings) with "%.*s" and this precision, and at
+     * most one of them, so a message fits in its buffer.
+     */
+#define REPORT_MAX_QUOTE 100
+
+    void report_error(session*, report_code, const char*, ...);
+    void report_warning(session*, report_code, const char*, ...);
+    void report_failure(parameters*, const char*);
+
+#endif
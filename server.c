@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "mat.h"
+#include "server.h"
+
+#define BACKLOG 16
+
+/*
+ * connection:
+ * what the thread of a connection needs: the socket, the format of
+ * the errors of its session, the matrices array and the function that
+ * runs a session.
+ */
+typedef struct connection {
+    int fd;
+    int errors;
+    mat *matrices;
+    void (*run)(session*, mat*);
+} connection;
+
+/*
+ * serve_connection:
+ * an auxiliary function
+ * the body of the thread of a connection: wraps the socket in a pair
+ * of streams, runs the session on them and closes the connection when
+ * it's done. the session may not read or write files: any client could
+ * otherwise reach any path the server can.
+ */
+static void *serve_connection(void *arg){
+    connection *conn = arg;
+    session ses;
+    int out_fd = dup(conn->fd);
+    ses.in = fdopen(conn->fd, "r");
+    ses.out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    ses.errors = conn->errors;
+    ses.files = 0;
+    ses.line = NULL;
+    ses.length = ses.column = 0;
+    ses.line_number = 0;
+    if (ses.in != NULL && ses.out != NULL)
+        conn->run(&ses, conn->matrices);
+    if (ses.in != NULL)
+        fclose(ses.in);
+    else
+        close(conn->fd);
+    if (ses.out != NULL)
+        fclose(ses.out);
+    else if (out_fd >= 0)
+        close(out_fd);
+    free(conn);
+    return NULL;
+}
+
+/*
+ * listen_unix:
+ * an auxiliary function
+ * returns a socket listening on the Unix domain socket "path" (replacing
+ * a stale socket, but never a file of any other kind), -1 on failure.
+ */
+static int listen_unix(const char *path){
+    struct sockaddr_un address;
+    struct stat info;
+    int fd;
+    if (strlen(path) >= sizeof(address.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (!lstat(path, &info) && (!S_ISSOCK(info.st_mode) || unlink(path))){
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) || listen(fd, BACKLOG)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * listen_tcp:
+ * an auxiliary function
+ * returns a socket listening on "port" of the loopback interface only,
+ * -1 on failure.
+ */
+static int listen_tcp(int port){
+    struct sockaddr_in address;
+    int fd, reuse = 1;
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) || listen(fd, BACKLOG)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * serve:
+ * listens on the Unix domain socket "socket_path", or on "port" of the
+ * loopback interface if it's NULL, and runs "run" on the "matrices"
+ * for every connection, in a thread of its own, its errors reported in
+ * the format "errors" (see "report.h"). returns 0 if it cannot listen,
+ * otherwise it never returns.
+ */
+int serve(const char *socket_path, int port, int errors, mat *matrices, void (*run)(session*, mat*)){
+    pthread_attr_t attr;
+    pthread_t thread;
+    connection *conn;
+    int fd, client;
+    if ((fd = socket_path != NULL ? listen_unix(socket_path) : listen_tcp(port)) < 0)
+        return 0;
+    signal(SIGPIPE, SIG_IGN);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while(1){
+        if ((client = accept(fd, NULL, NULL)) < 0)
+            continue;
+        if ((conn = malloc(sizeof(connection))) == NULL){
+            close(client);
+            continue;
+        }
+        conn->fd = client;
+        conn->errors = errors;
+        conn->matrices = matrices;
+        conn->run = run;
+        if (pthread_create(&thread, &attr, serve_connection, conn)){
+            close(client);
+            free(conn);
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "mat.h"
+
+    /*
+     * the server: every connection gets a session of its own, run by a
+     * thread of its own, all of them working on the same matrices array
+     * (see "registry.h" for how they share it).
+     */
+    int serve(const char*, int, int, mat*, void (*)(session*, mat*));
+
+#endif